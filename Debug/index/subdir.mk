@@ -4,18 +4,60 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../index/arena.c \
+../index/art.c \
+../index/binary-index.c \
+../index/char-class.c \
+../index/dictionary.c \
+../index/file-map.c \
+../index/hash-table.c \
 ../index/index.c \
+../index/manifest.c \
+../index/postings.c \
+../index/query.c \
+../index/run-file.c \
+../index/scheduler.c \
 ../index/sorted-list.c \
+../index/string-sort.c \
+../index/term-counts.c \
 ../index/tokenizer.c 
 
 OBJS += \
+./index/arena.o \
+./index/art.o \
+./index/binary-index.o \
+./index/char-class.o \
+./index/dictionary.o \
+./index/file-map.o \
+./index/hash-table.o \
 ./index/index.o \
+./index/manifest.o \
+./index/postings.o \
+./index/query.o \
+./index/run-file.o \
+./index/scheduler.o \
 ./index/sorted-list.o \
+./index/string-sort.o \
+./index/term-counts.o \
 ./index/tokenizer.o 
 
 C_DEPS += \
+./index/arena.d \
+./index/art.d \
+./index/binary-index.d \
+./index/char-class.d \
+./index/dictionary.d \
+./index/file-map.d \
+./index/hash-table.d \
 ./index/index.d \
+./index/manifest.d \
+./index/postings.d \
+./index/query.d \
+./index/run-file.d \
+./index/scheduler.d \
 ./index/sorted-list.d \
+./index/string-sort.d \
+./index/term-counts.d \
 ./index/tokenizer.d 
 
 
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include "arena.h"
+
+/* Chunk headers are padded so that the memory after them is aligned. */
+#define CHUNK_HEADER_SIZE ( ( sizeof(struct ArenaChunk) + ARENA_ALIGNMENT - 1 ) & ~(size_t)( ARENA_ALIGNMENT - 1 ) )
+
+static struct ArenaChunk* newChunk( ArenaPtr arena, size_t size );
+static int sizeClass( size_t size );
+
+/**
+ * Allocate a chunk with room for size bytes and account for it in arena.
+ * The caller links it into the arena's list.
+ *
+ * Return the chunk, or NULL if no memory could be allocated.
+ */
+static struct ArenaChunk* newChunk( ArenaPtr arena, size_t size )
+{
+	struct ArenaChunk* chunk = malloc( CHUNK_HEADER_SIZE + size );
+
+	if( chunk == NULL )
+	{
+		return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	arena->bytes += size;
+
+	return chunk;
+}
+
+/**
+ * Return the pool size class of a block of at least size bytes.
+ */
+static int sizeClass( size_t size )
+{
+	int c = ARENA_MIN_CLASS;
+
+	while( ( (size_t)1 << c ) < size )
+	{
+		c++;
+	}
+
+	return c;
+}
+
+ArenaPtr ArenaCreate()
+{
+	ArenaPtr arena = calloc( 1, sizeof(*arena) );
+
+	return arena;
+}
+
+void* ArenaAlloc( ArenaPtr arena, size_t size )
+{
+	size = ( size + ARENA_ALIGNMENT - 1 ) & ~(size_t)( ARENA_ALIGNMENT - 1 );
+
+	struct ArenaChunk* chunk = arena->chunks;
+
+	/* A large allocation fills a chunk of its own, which goes behind the current one. */
+	if( size > ARENA_LARGE_SIZE )
+	{
+		struct ArenaChunk* large = newChunk( arena, size );
+
+		if( large == NULL )
+		{
+			return NULL;
+		}
+
+		large->used = size;
+
+		if( chunk != NULL )
+		{
+			large->next = chunk->next;
+			chunk->next = large;
+		}
+		else
+		{
+			arena->chunks = large;
+		}
+
+		return (char*)large + CHUNK_HEADER_SIZE;
+	}
+
+	if( chunk == NULL || chunk->size - chunk->used < size )
+	{
+		chunk = newChunk( arena, ARENA_CHUNK_SIZE );
+
+		if( chunk == NULL )
+		{
+			return NULL;
+		}
+
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	void* memory = (char*)chunk + CHUNK_HEADER_SIZE + chunk->used;
+	chunk->used += size;
+
+	return memory;
+}
+
+void* ArenaAllocAligned( ArenaPtr arena, size_t size, size_t alignment )
+{
+	/* Sized as ArenaAlloc will size it, so that the fit is checked against what it takes. */
+	size = ( size + ARENA_ALIGNMENT - 1 ) & ~(size_t)( ARENA_ALIGNMENT - 1 );
+
+	struct ArenaChunk* chunk = arena->chunks;
+
+	/* A large allocation would not come from the current chunk, so padding it would be wasted. */
+	if( chunk != NULL && size <= ARENA_LARGE_SIZE )
+	{
+		uintptr_t next = (uintptr_t)chunk + CHUNK_HEADER_SIZE + chunk->used;
+		size_t padding = ( -next ) & ( alignment - 1 );
+
+		if( padding <= chunk->size - chunk->used && size <= chunk->size - chunk->used - padding )
+		{
+			chunk->used += padding;
+			return ArenaAlloc( arena, size );
+		}
+	}
+
+	/* Ask for enough that an aligned block fits wherever the memory lands. */
+	char* memory = ArenaAlloc( arena, size + alignment - ARENA_ALIGNMENT );
+
+	if( memory == NULL )
+	{
+		return NULL;
+	}
+
+	return memory + ( ( -(uintptr_t)memory ) & ( alignment - 1 ) );
+}
+
+size_t ArenaPoolSize( size_t size )
+{
+	return (size_t)1 << sizeClass( size );
+}
+
+void* ArenaPoolAlloc( ArenaPtr arena, size_t size )
+{
+	int c = sizeClass( size );
+	void* block = arena->free_lists[c];
+
+	if( block != NULL )
+	{
+		arena->free_lists[c] = *(void**)block;
+		return block;
+	}
+
+	return ArenaAlloc( arena, (size_t)1 << c );
+}
+
+void ArenaPoolFree( ArenaPtr arena, void* block, size_t size )
+{
+	if( block == NULL )
+	{
+		return;
+	}
+
+	int c = sizeClass( size );
+
+	*(void**)block = arena->free_lists[c];
+	arena->free_lists[c] = block;
+}
+
+void ArenaMerge( ArenaPtr dest, ArenaPtr src )
+{
+	int c;
+
+	/* src's chunks go behind dest's current chunk, so that dest keeps allocating from it. */
+	if( src->chunks != NULL )
+	{
+		struct ArenaChunk* last = src->chunks;
+
+		while( last->next != NULL )
+		{
+			last = last->next;
+		}
+
+		if( dest->chunks != NULL )
+		{
+			last->next = dest->chunks->next;
+			dest->chunks->next = src->chunks;
+		}
+		else
+		{
+			dest->chunks = src->chunks;
+		}
+	}
+
+	for( c = 0; c < ARENA_SIZE_CLASSES; c++ )
+	{
+		void* block = src->free_lists[c];
+
+		while( block != NULL )
+		{
+			void* next = *(void**)block;
+			*(void**)block = dest->free_lists[c];
+			dest->free_lists[c] = block;
+			block = next;
+		}
+	}
+
+	dest->bytes += src->bytes;
+	free( src );
+}
+
+void ArenaDestroy( ArenaPtr arena )
+{
+	if( arena == NULL )
+	{
+		return;
+	}
+
+	struct ArenaChunk* chunk = arena->chunks;
+
+	while( chunk != NULL )
+	{
+		struct ArenaChunk* next = chunk->next;
+		free( chunk );
+		chunk = next;
+	}
+
+	free( arena );
+}
@@ -0,0 +1,106 @@
+#ifndef index_arena_h
+#define index_arena_h
+
+#include <stddef.h>
+
+/*
+ * arena.h
+ *
+ * A bump allocator that owns every object of one index.  Memory is carved out
+ * of large chunks with no per-object header, and is only given back when the
+ * whole arena is destroyed, with one free per chunk.
+ *
+ * For objects that are outgrown and replaced, such as postings arrays, the
+ * arena also keeps a pool of power-of-two size classes: a block returned with
+ * ArenaPoolFree goes on its class's free list and is handed out again by the
+ * next ArenaPoolAlloc of that class.
+ *
+ * An arena is not thread-safe; each thread building an index uses its own.
+ */
+
+/* The size of an ordinary chunk. */
+#define ARENA_CHUNK_SIZE (1024 * 1024)
+
+/* Allocations larger than this get a chunk of their own rather than using up the current one. */
+#define ARENA_LARGE_SIZE ( ARENA_CHUNK_SIZE / 4 )
+
+/* Every allocation is aligned to this many bytes. */
+#define ARENA_ALIGNMENT 8
+
+/* Pool blocks are 2^ARENA_MIN_CLASS bytes and up. */
+#define ARENA_MIN_CLASS 4
+#define ARENA_SIZE_CLASSES 64
+
+struct ArenaChunk
+{
+	struct ArenaChunk* next;
+	size_t size;
+	size_t used;
+};
+
+struct Arena
+{
+	/* The chunk allocations are taken from, followed by all earlier ones. */
+	struct ArenaChunk* chunks;
+
+	/* Free pool blocks, by size class; each block's first word links to the next. */
+	void* free_lists[ARENA_SIZE_CLASSES];
+
+	/* The total size of all chunks. */
+	size_t bytes;
+};
+typedef struct Arena* ArenaPtr;
+
+/*
+ * ArenaCreate creates a new, empty arena.
+ *
+ * If the function succeeds, it returns a non-NULL ArenaPtr.
+ * Else it returns NULL.
+ */
+ArenaPtr ArenaCreate();
+
+/*
+ * ArenaAlloc returns size bytes of uninitialized memory from the arena, or
+ * NULL if no memory could be allocated.  The memory cannot be freed singly.
+ */
+void* ArenaAlloc( ArenaPtr arena, size_t size );
+
+/*
+ * ArenaAllocAligned is ArenaAlloc for memory aligned to alignment bytes, a
+ * power of two no smaller than ARENA_ALIGNMENT, such as a cache line.  The
+ * bytes skipped to reach the alignment are not used for anything else.
+ */
+void* ArenaAllocAligned( ArenaPtr arena, size_t size, size_t alignment );
+
+/*
+ * ArenaPoolSize returns the size of the block that ArenaPoolAlloc hands out
+ * for a request of size bytes: size rounded up to its size class.
+ */
+size_t ArenaPoolSize( size_t size );
+
+/*
+ * ArenaPoolAlloc returns a block of at least size bytes (ArenaPoolSize(size)
+ * bytes, in fact), reusing a freed block of the same class if there is one.
+ * Returns NULL if no memory could be allocated.
+ */
+void* ArenaPoolAlloc( ArenaPtr arena, size_t size );
+
+/*
+ * ArenaPoolFree returns a block from ArenaPoolAlloc to the pool.  size must
+ * be the size the block was requested with, or any size of the same class.
+ */
+void ArenaPoolFree( ArenaPtr arena, void* block, size_t size );
+
+/*
+ * ArenaMerge moves all of src's memory, including its free pool blocks, into
+ * dest and destroys src.  Objects allocated from src stay where they are and
+ * are then owned by dest.
+ */
+void ArenaMerge( ArenaPtr dest, ArenaPtr src );
+
+/*
+ * ArenaDestroy frees the arena and every object allocated from it.
+ */
+void ArenaDestroy( ArenaPtr arena );
+
+#endif
@@ -0,0 +1,727 @@
+#include <stdlib.h>
+#include <string.h>
+#include "art.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Children are tagged pointers; a leaf has its lowest bit set. */
+#define IS_LEAF( p ) ( (uintptr_t)(p) & 1 )
+#define TO_LEAF( p ) ( (ArtLeafPtr)( (uintptr_t)(p) & ~(uintptr_t)1 ) )
+#define TAG_LEAF( l ) ( (void*)( (uintptr_t)(l) | 1 ) )
+
+#define MIN( a, b ) ( (a) < (b) ? (a) : (b) )
+
+static int addChild( void** ref, ArtNodePtr node, unsigned char byte, void* child );
+static size_t checkPrefix( ArtNodePtr node, const char* key, size_t length, size_t depth );
+static void copyHeader( ArtNodePtr dest, ArtNodePtr src );
+static void destroyNode( void* p );
+static void** findChild( ArtNodePtr node, unsigned char byte );
+static int leafMatches( ArtLeafPtr leaf, const char* key, size_t length );
+static ArtLeafPtr minimumLeaf( void* p );
+static ArtLeafPtr newLeaf( const char* key, size_t length );
+static ArtNodePtr newNode( int type );
+static void placeLeaf( ArtNodePtr node, ArtLeafPtr leaf, size_t depth );
+static size_t prefixMismatch( ArtNodePtr node, const char* key, size_t length, size_t depth );
+static void walkNode( void* p, ArtVisitFn visit, void* context );
+
+/**
+ * Add child under byte to node, which has no child for that byte yet.  A full
+ * node is replaced by a node of the next size, and *ref is updated to point
+ * to the replacement.
+ *
+ * Return 1 if successful, 0 if no memory could be allocated.
+ */
+static int addChild( void** ref, ArtNodePtr node, unsigned char byte, void* child )
+{
+	int i;
+
+	switch( node->type )
+	{
+		case ART_NODE4:
+		{
+			struct ArtNode4* n = (struct ArtNode4*)node;
+
+			if( node->child_count < 4 )
+			{
+				/* Keys are kept in order, for the walk. */
+				for( i = node->child_count; i > 0 && n->keys[i - 1] > byte; i-- )
+				{
+					n->keys[i] = n->keys[i - 1];
+					n->children[i] = n->children[i - 1];
+				}
+
+				n->keys[i] = byte;
+				n->children[i] = child;
+				node->child_count++;
+				return 1;
+			}
+
+			struct ArtNode16* bigger = (struct ArtNode16*)newNode( ART_NODE16 );
+
+			if( bigger == NULL )
+			{
+				return 0;
+			}
+
+			copyHeader( &bigger->n, node );
+			memcpy( bigger->keys, n->keys, sizeof(n->keys) );
+			memcpy( bigger->children, n->children, sizeof(n->children) );
+			*ref = bigger;
+			free( n );
+
+			return addChild( ref, &bigger->n, byte, child );
+		}
+
+		case ART_NODE16:
+		{
+			struct ArtNode16* n = (struct ArtNode16*)node;
+
+			if( node->child_count < 16 )
+			{
+				for( i = node->child_count; i > 0 && n->keys[i - 1] > byte; i-- )
+				{
+					n->keys[i] = n->keys[i - 1];
+					n->children[i] = n->children[i - 1];
+				}
+
+				n->keys[i] = byte;
+				n->children[i] = child;
+				node->child_count++;
+				return 1;
+			}
+
+			struct ArtNode48* bigger = (struct ArtNode48*)newNode( ART_NODE48 );
+
+			if( bigger == NULL )
+			{
+				return 0;
+			}
+
+			copyHeader( &bigger->n, node );
+			for( i = 0; i < 16; i++ )
+			{
+				bigger->index[n->keys[i]] = i + 1;
+				bigger->children[i] = n->children[i];
+			}
+			*ref = bigger;
+			free( n );
+
+			return addChild( ref, &bigger->n, byte, child );
+		}
+
+		case ART_NODE48:
+		{
+			struct ArtNode48* n = (struct ArtNode48*)node;
+
+			if( node->child_count < 48 )
+			{
+				/* Removals can leave holes, so look for a free position. */
+				for( i = 0; n->children[i] != NULL; i++ );
+
+				n->index[byte] = i + 1;
+				n->children[i] = child;
+				node->child_count++;
+				return 1;
+			}
+
+			struct ArtNode256* bigger = (struct ArtNode256*)newNode( ART_NODE256 );
+
+			if( bigger == NULL )
+			{
+				return 0;
+			}
+
+			copyHeader( &bigger->n, node );
+			for( i = 0; i < 256; i++ )
+			{
+				if( n->index[i] != 0 )
+				{
+					bigger->children[i] = n->children[n->index[i] - 1];
+				}
+			}
+			*ref = bigger;
+			free( n );
+
+			return addChild( ref, &bigger->n, byte, child );
+		}
+
+		default:
+		{
+			struct ArtNode256* n = (struct ArtNode256*)node;
+
+			n->children[byte] = child;
+			node->child_count++;
+			return 1;
+		}
+	}
+}
+
+/**
+ * Return the number of the node's stored prefix bytes that match key at depth.
+ */
+static size_t checkPrefix( ArtNodePtr node, const char* key, size_t length, size_t depth )
+{
+	size_t limit = MIN( MIN( node->prefix_length, ART_MAX_PREFIX ), length - depth );
+	size_t i;
+
+	for( i = 0; i < limit; i++ )
+	{
+		if( node->prefix[i] != (unsigned char)key[depth + i] )
+		{
+			break;
+		}
+	}
+
+	return i;
+}
+
+static void copyHeader( ArtNodePtr dest, ArtNodePtr src )
+{
+	dest->child_count = src->child_count;
+	dest->prefix_length = src->prefix_length;
+	memcpy( dest->prefix, src->prefix, ART_MAX_PREFIX );
+	dest->terminal = src->terminal;
+}
+
+/**
+ * Free the node or leaf p and everything below it.
+ */
+static void destroyNode( void* p )
+{
+	int i;
+
+	if( p == NULL )
+	{
+		return;
+	}
+
+	if( IS_LEAF( p ) )
+	{
+		free( TO_LEAF( p ) );
+		return;
+	}
+
+	ArtNodePtr node = p;
+
+	switch( node->type )
+	{
+		case ART_NODE4:
+			for( i = 0; i < node->child_count; i++ )
+			{
+				destroyNode( ((struct ArtNode4*)node)->children[i] );
+			}
+			break;
+
+		case ART_NODE16:
+			for( i = 0; i < node->child_count; i++ )
+			{
+				destroyNode( ((struct ArtNode16*)node)->children[i] );
+			}
+			break;
+
+		case ART_NODE48:
+			for( i = 0; i < 48; i++ )
+			{
+				destroyNode( ((struct ArtNode48*)node)->children[i] );
+			}
+			break;
+
+		default:
+			for( i = 0; i < 256; i++ )
+			{
+				destroyNode( ((struct ArtNode256*)node)->children[i] );
+			}
+			break;
+	}
+
+	free( node->terminal );
+	free( node );
+}
+
+/**
+ * Return the node's slot for the child under byte, or NULL if there is none.
+ */
+static void** findChild( ArtNodePtr node, unsigned char byte )
+{
+	int i;
+
+	switch( node->type )
+	{
+		case ART_NODE4:
+		{
+			struct ArtNode4* n = (struct ArtNode4*)node;
+
+			for( i = 0; i < node->child_count; i++ )
+			{
+				if( n->keys[i] == byte )
+				{
+					return &n->children[i];
+				}
+			}
+			return NULL;
+		}
+
+		case ART_NODE16:
+		{
+			struct ArtNode16* n = (struct ArtNode16*)node;
+#ifdef __SSE2__
+			/* Compare all 16 keys at once, ignoring the unused ones. */
+			__m128i keys = _mm_loadu_si128( (const __m128i*)n->keys );
+			unsigned int matches = _mm_movemask_epi8( _mm_cmpeq_epi8( keys, _mm_set1_epi8( (char)byte ) ) );
+
+			matches &= ( 1u << node->child_count ) - 1;
+
+			return matches != 0 ? &n->children[__builtin_ctz( matches )] : NULL;
+#else
+			for( i = 0; i < node->child_count; i++ )
+			{
+				if( n->keys[i] == byte )
+				{
+					return &n->children[i];
+				}
+			}
+			return NULL;
+#endif
+		}
+
+		case ART_NODE48:
+		{
+			struct ArtNode48* n = (struct ArtNode48*)node;
+
+			return n->index[byte] != 0 ? &n->children[n->index[byte] - 1] : NULL;
+		}
+
+		default:
+		{
+			struct ArtNode256* n = (struct ArtNode256*)node;
+
+			return n->children[byte] != NULL ? &n->children[byte] : NULL;
+		}
+	}
+}
+
+static int leafMatches( ArtLeafPtr leaf, const char* key, size_t length )
+{
+	return leaf->length == length && memcmp( leaf->key, key, length ) == 0;
+}
+
+/**
+ * Return the leaf with the smallest key at or below p, or NULL if there is none.
+ */
+static ArtLeafPtr minimumLeaf( void* p )
+{
+	int i;
+
+	while( p != NULL && !IS_LEAF( p ) )
+	{
+		ArtNodePtr node = p;
+
+		/* A key ending here is a prefix of, and so smaller than, every key below. */
+		if( node->terminal != NULL )
+		{
+			return node->terminal;
+		}
+
+		switch( node->type )
+		{
+			case ART_NODE4:
+				p = node->child_count > 0 ? ((struct ArtNode4*)node)->children[0] : NULL;
+				break;
+
+			case ART_NODE16:
+				p = node->child_count > 0 ? ((struct ArtNode16*)node)->children[0] : NULL;
+				break;
+
+			case ART_NODE48:
+			{
+				struct ArtNode48* n = (struct ArtNode48*)node;
+
+				for( i = 0; i < 256 && n->index[i] == 0; i++ );
+				p = i < 256 ? n->children[n->index[i] - 1] : NULL;
+				break;
+			}
+
+			default:
+			{
+				struct ArtNode256* n = (struct ArtNode256*)node;
+
+				for( i = 0; i < 256 && n->children[i] == NULL; i++ );
+				p = i < 256 ? n->children[i] : NULL;
+				break;
+			}
+		}
+	}
+
+	return p != NULL ? TO_LEAF( p ) : NULL;
+}
+
+static ArtLeafPtr newLeaf( const char* key, size_t length )
+{
+	ArtLeafPtr leaf = malloc( sizeof(*leaf) );
+
+	if( leaf == NULL )
+	{
+		return NULL;
+	}
+
+	leaf->key = key;
+	leaf->length = length;
+	leaf->value = NULL;
+
+	return leaf;
+}
+
+static ArtNodePtr newNode( int type )
+{
+	static const size_t sizes[] =
+	{
+		sizeof(struct ArtNode4),
+		sizeof(struct ArtNode16),
+		sizeof(struct ArtNode48),
+		sizeof(struct ArtNode256)
+	};
+
+	ArtNodePtr node = calloc( 1, sizes[type] );
+
+	if( node != NULL )
+	{
+		node->type = type;
+	}
+
+	return node;
+}
+
+/**
+ * Put leaf under a new, not yet full node whose keys all share their first
+ * depth bytes: as its terminal if the leaf's key ends there, else as a child.
+ */
+static void placeLeaf( ArtNodePtr node, ArtLeafPtr leaf, size_t depth )
+{
+	if( leaf->length == depth )
+	{
+		node->terminal = leaf;
+	}
+	else
+	{
+		addChild( NULL, node, leaf->key[depth], TAG_LEAF( leaf ) );
+	}
+}
+
+/**
+ * Return the length of the match between the node's whole prefix and key at
+ * depth.  Prefix bytes beyond those stored are read from a leaf below the node.
+ */
+static size_t prefixMismatch( ArtNodePtr node, const char* key, size_t length, size_t depth )
+{
+	size_t limit = MIN( MIN( node->prefix_length, ART_MAX_PREFIX ), length - depth );
+	size_t i;
+
+	for( i = 0; i < limit; i++ )
+	{
+		if( node->prefix[i] != (unsigned char)key[depth + i] )
+		{
+			return i;
+		}
+	}
+
+	if( node->prefix_length > ART_MAX_PREFIX )
+	{
+		ArtLeafPtr leaf = minimumLeaf( node );
+
+		limit = MIN( MIN( leaf->length, length ) - depth, node->prefix_length );
+
+		for( ; i < limit; i++ )
+		{
+			if( leaf->key[depth + i] != key[depth + i] )
+			{
+				return i;
+			}
+		}
+	}
+
+	return i;
+}
+
+/**
+ * Visit every key at or below p, in ascending order.
+ */
+static void walkNode( void* p, ArtVisitFn visit, void* context )
+{
+	int i;
+
+	if( p == NULL )
+	{
+		return;
+	}
+
+	if( IS_LEAF( p ) )
+	{
+		ArtLeafPtr leaf = TO_LEAF( p );
+		visit( context, leaf->key, leaf->length, leaf->value );
+		return;
+	}
+
+	ArtNodePtr node = p;
+
+	if( node->terminal != NULL )
+	{
+		visit( context, node->terminal->key, node->terminal->length, node->terminal->value );
+	}
+
+	switch( node->type )
+	{
+		case ART_NODE4:
+			for( i = 0; i < node->child_count; i++ )
+			{
+				walkNode( ((struct ArtNode4*)node)->children[i], visit, context );
+			}
+			break;
+
+		case ART_NODE16:
+			for( i = 0; i < node->child_count; i++ )
+			{
+				walkNode( ((struct ArtNode16*)node)->children[i], visit, context );
+			}
+			break;
+
+		case ART_NODE48:
+		{
+			struct ArtNode48* n = (struct ArtNode48*)node;
+
+			for( i = 0; i < 256; i++ )
+			{
+				if( n->index[i] != 0 )
+				{
+					walkNode( n->children[n->index[i] - 1], visit, context );
+				}
+			}
+			break;
+		}
+
+		default:
+			for( i = 0; i < 256; i++ )
+			{
+				walkNode( ((struct ArtNode256*)node)->children[i], visit, context );
+			}
+			break;
+	}
+}
+
+ArtTreePtr ArtCreate()
+{
+	return calloc( 1, sizeof(struct ArtTree) );
+}
+
+void** ArtFind( ArtTreePtr tree, const char* key, size_t length )
+{
+	void* p = tree->root;
+	size_t depth = 0;
+
+	while( p != NULL )
+	{
+		if( IS_LEAF( p ) )
+		{
+			ArtLeafPtr leaf = TO_LEAF( p );
+			return leafMatches( leaf, key, length ) ? &leaf->value : NULL;
+		}
+
+		ArtNodePtr node = p;
+
+		/* Only the stored prefix bytes are checked here; the leaf's key is compared in full at the end. */
+		if( node->prefix_length > 0 )
+		{
+			if( depth + node->prefix_length > length ||
+				checkPrefix( node, key, length, depth ) != MIN( node->prefix_length, ART_MAX_PREFIX ) )
+			{
+				return NULL;
+			}
+			depth += node->prefix_length;
+		}
+
+		if( depth == length )
+		{
+			ArtLeafPtr leaf = node->terminal;
+			return leaf != NULL && leafMatches( leaf, key, length ) ? &leaf->value : NULL;
+		}
+
+		void** slot = findChild( node, key[depth] );
+
+		if( slot == NULL )
+		{
+			return NULL;
+		}
+
+		p = *slot;
+		depth++;
+	}
+
+	return NULL;
+}
+
+void** ArtPut( ArtTreePtr tree, const char* key, size_t length )
+{
+	void** ref = &tree->root;
+	size_t depth = 0;
+
+	while( 1 )
+	{
+		void* p = *ref;
+
+		if( p == NULL )
+		{
+			ArtLeafPtr leaf = newLeaf( key, length );
+
+			if( leaf == NULL )
+			{
+				return NULL;
+			}
+
+			*ref = TAG_LEAF( leaf );
+			tree->count++;
+			return &leaf->value;
+		}
+
+		if( IS_LEAF( p ) )
+		{
+			ArtLeafPtr existing = TO_LEAF( p );
+
+			if( leafMatches( existing, key, length ) )
+			{
+				return &existing->value;
+			}
+
+			/* Split the leaf: a new node holds the part both keys share, and the two leaves below it. */
+			ArtLeafPtr leaf = newLeaf( key, length );
+			ArtNodePtr node = newNode( ART_NODE4 );
+
+			if( leaf == NULL || node == NULL )
+			{
+				free( leaf );
+				free( node );
+				return NULL;
+			}
+
+			size_t limit = MIN( existing->length, length );
+			size_t common = 0;
+
+			while( depth + common < limit && existing->key[depth + common] == key[depth + common] )
+			{
+				common++;
+			}
+
+			node->prefix_length = common;
+			memcpy( node->prefix, key + depth, MIN( common, ART_MAX_PREFIX ) );
+			placeLeaf( node, existing, depth + common );
+			placeLeaf( node, leaf, depth + common );
+
+			*ref = node;
+			tree->count++;
+			return &leaf->value;
+		}
+
+		ArtNodePtr node = p;
+
+		if( node->prefix_length > 0 )
+		{
+			size_t match = prefixMismatch( node, key, length, depth );
+
+			if( match < node->prefix_length )
+			{
+				/* Split the prefix: a new node holds the part that matches, with node and the new leaf below it. */
+				ArtLeafPtr leaf = newLeaf( key, length );
+				ArtNodePtr parent = newNode( ART_NODE4 );
+
+				if( leaf == NULL || parent == NULL )
+				{
+					free( leaf );
+					free( parent );
+					return NULL;
+				}
+
+				parent->prefix_length = match;
+				memcpy( parent->prefix, node->prefix, MIN( match, ART_MAX_PREFIX ) );
+
+				unsigned char byte;
+
+				if( node->prefix_length <= ART_MAX_PREFIX )
+				{
+					byte = node->prefix[match];
+					node->prefix_length -= match + 1;
+					memmove( node->prefix, node->prefix + match + 1, MIN( node->prefix_length, ART_MAX_PREFIX ) );
+				}
+				else
+				{
+					/* The bytes after the stored ones come from a key below node. */
+					ArtLeafPtr below = minimumLeaf( node );
+
+					byte = below->key[depth + match];
+					node->prefix_length -= match + 1;
+					memcpy( node->prefix, below->key + depth + match + 1, MIN( node->prefix_length, ART_MAX_PREFIX ) );
+				}
+
+				addChild( NULL, parent, byte, node );
+				placeLeaf( parent, leaf, depth + match );
+
+				*ref = parent;
+				tree->count++;
+				return &leaf->value;
+			}
+
+			depth += node->prefix_length;
+		}
+
+		if( depth == length )
+		{
+			if( node->terminal == NULL )
+			{
+				node->terminal = newLeaf( key, length );
+
+				if( node->terminal == NULL )
+				{
+					return NULL;
+				}
+				tree->count++;
+			}
+
+			return &node->terminal->value;
+		}
+
+		void** slot = findChild( node, key[depth] );
+
+		if( slot != NULL )
+		{
+			ref = slot;
+			depth++;
+			continue;
+		}
+
+		ArtLeafPtr leaf = newLeaf( key, length );
+
+		if( leaf == NULL || !addChild( ref, node, key[depth], TAG_LEAF( leaf ) ) )
+		{
+			free( leaf );
+			return NULL;
+		}
+
+		tree->count++;
+		return &leaf->value;
+	}
+}
+
+void ArtWalk( ArtTreePtr tree, ArtVisitFn visit, void* context )
+{
+	walkNode( tree->root, visit, context );
+}
+
+void ArtDestroy( ArtTreePtr tree )
+{
+	if( tree == NULL )
+	{
+		return;
+	}
+
+	destroyNode( tree->root );
+	free( tree );
+}
@@ -0,0 +1,137 @@
+#ifndef index_art_h
+#define index_art_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * art.h
+ *
+ * An adaptive radix tree mapping byte strings to pointers.  Each inner node
+ * branches on one byte of the key, and grows through four sizes (4, 16, 48
+ * and 256 children) as it fills, so sparse nodes stay small.  A run of bytes
+ * shared by every key below a node is stored once, in the node, rather than
+ * as a chain of single-child nodes; only its first ART_MAX_PREFIX bytes are
+ * kept, and the rest are checked against a key at a leaf when needed.
+ *
+ * A key that ends at an inner node (a prefix of other keys) is held in the
+ * node's terminal leaf.  Walking the tree visits the keys in ascending byte
+ * order, which is strcmp order for keys without null bytes.
+ *
+ * Keys are not copied: each must stay valid for as long as it is in the tree.
+ */
+
+/* The number of prefix bytes stored in an inner node. */
+#define ART_MAX_PREFIX 8
+
+enum ArtNodeType
+{
+	ART_NODE4,
+	ART_NODE16,
+	ART_NODE48,
+	ART_NODE256
+};
+
+struct ArtLeaf
+{
+	const char* key;
+	size_t length;
+	void* value;
+};
+typedef struct ArtLeaf* ArtLeafPtr;
+
+/*
+ * The header shared by the four inner node types.  Children are tagged
+ * pointers: a leaf has its lowest bit set.
+ */
+struct ArtNode
+{
+	uint8_t type;
+	uint16_t child_count;
+
+	/* The length of the prefix shared below this node, of which the first ART_MAX_PREFIX bytes are stored. */
+	uint32_t prefix_length;
+	unsigned char prefix[ART_MAX_PREFIX];
+
+	/* The key that ends at this node, if any. */
+	ArtLeafPtr terminal;
+};
+typedef struct ArtNode* ArtNodePtr;
+
+struct ArtNode4
+{
+	struct ArtNode n;
+	unsigned char keys[4];
+	void* children[4];
+};
+
+struct ArtNode16
+{
+	struct ArtNode n;
+	unsigned char keys[16];
+	void* children[16];
+};
+
+struct ArtNode48
+{
+	struct ArtNode n;
+	/* One more than the position in children of each byte's child, or 0. */
+	unsigned char index[256];
+	void* children[48];
+};
+
+struct ArtNode256
+{
+	struct ArtNode n;
+	void* children[256];
+};
+
+struct ArtTree
+{
+	/* An inner node or a tagged leaf, or NULL while the tree is empty. */
+	void* root;
+	size_t count;
+};
+typedef struct ArtTree* ArtTreePtr;
+
+/*
+ * The function called for each key by ArtWalk.
+ */
+typedef void (*ArtVisitFn)( void* context, const char* key, size_t length, void* value );
+
+/*
+ * ArtCreate creates a new, empty tree.
+ *
+ * If the function succeeds, it returns a non-NULL ArtTreePtr.
+ * Else it returns NULL.
+ */
+ArtTreePtr ArtCreate();
+
+/*
+ * ArtFind looks up the length bytes at key.
+ *
+ * Returns a pointer to the key's value, or NULL if the key is not in the tree.
+ */
+void** ArtFind( ArtTreePtr tree, const char* key, size_t length );
+
+/*
+ * ArtPut looks up the length bytes at key, adding the key with a NULL value
+ * if it is not in the tree yet.
+ *
+ * Returns a pointer to the key's value, or NULL if the key had to be added
+ * and no memory could be allocated.
+ */
+void** ArtPut( ArtTreePtr tree, const char* key, size_t length );
+
+/*
+ * ArtWalk calls visit for every key in the tree, in ascending order.  The
+ * tree must not be changed during the walk.
+ */
+void ArtWalk( ArtTreePtr tree, ArtVisitFn visit, void* context );
+
+/*
+ * ArtDestroy destroys the tree.  The keys and values are not freed.
+ */
+void ArtDestroy( ArtTreePtr tree );
+
+#endif
@@ -0,0 +1,793 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binary-index.h"
+#include "bm25.h"
+
+static int appendTerm( BIWriterPtr writer, const char* term, size_t term_length, size_t count );
+static int compareFileIDs( const void* a, const void* b );
+static int compareTerm( const char* string, size_t string_length, const char* term, size_t length );
+static uint64_t read32( const unsigned char* p );
+static uint64_t read64( const unsigned char* p );
+static float readFloat( const unsigned char* p );
+static int readVarint( const unsigned char** p, const unsigned char* end, uint64_t* value );
+static float roundUp( double value );
+static const char* termString( BinaryIndexPtr index, struct BITermEntry* entry );
+static void writeBytes( BIWriterPtr writer, const void* bytes, size_t length );
+static void writeFloat( BIWriterPtr writer, float value );
+static void writePadding( BIWriterPtr writer );
+static void write32( BIWriterPtr writer, uint64_t value );
+static void write64( BIWriterPtr writer, uint64_t value );
+static void writeVarint( BIWriterPtr writer, uint64_t value );
+
+/**
+ * Add an entry for a term with count postings, which start at the writer's
+ * position, to the dictionary kept in memory.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int appendTerm( BIWriterPtr writer, const char* term, size_t term_length, size_t count )
+{
+	if( writer->term_count == writer->term_capacity )
+	{
+		size_t capacity = writer->term_capacity == 0 ? 1024 : writer->term_capacity * 2;
+		struct BITermEntry* terms = realloc( writer->terms, capacity * sizeof(*terms) );
+
+		if( terms == NULL )
+		{
+			return 0;
+		}
+
+		writer->terms = terms;
+		writer->term_capacity = capacity;
+	}
+
+	if( writer->strings_length + term_length + 1 > writer->strings_capacity )
+	{
+		size_t capacity = writer->strings_capacity == 0 ? 64 * 1024 : writer->strings_capacity;
+
+		while( writer->strings_length + term_length + 1 > capacity )
+		{
+			capacity *= 2;
+		}
+
+		char* strings = realloc( writer->strings, capacity );
+
+		if( strings == NULL )
+		{
+			return 0;
+		}
+
+		writer->strings = strings;
+		writer->strings_capacity = capacity;
+	}
+
+	struct BITermEntry* entry = &writer->terms[writer->term_count++];
+
+	entry->string_offset = writer->strings_length;
+	entry->postings_offset = writer->position - BI_HEADER_SIZE;
+	entry->string_length = (uint32_t)term_length;
+	entry->posting_count = (uint32_t)count;
+
+	memcpy( writer->strings + writer->strings_length, term, term_length );
+	writer->strings[writer->strings_length + term_length] = '\0';
+	writer->strings_length += term_length + 1;
+
+	return 1;
+}
+
+/**
+ * Order two postings by ascending file ID, for qsort.
+ */
+static int compareFileIDs( const void* a, const void* b )
+{
+	uint32_t x = ( (const struct Posting*)a )->file_id;
+	uint32_t y = ( (const struct Posting*)b )->file_id;
+
+	return ( x > y ) - ( x < y );
+}
+
+/**
+ * Compare the string_length bytes at string, a term of the dictionary, with
+ * the length bytes at term, as strcmp would.
+ */
+static int compareTerm( const char* string, size_t string_length, const char* term, size_t length )
+{
+	size_t shorter = string_length < length ? string_length : length;
+	int order = memcmp( string, term, shorter );
+
+	if( order != 0 )
+	{
+		return order;
+	}
+
+	return ( string_length > length ) - ( string_length < length );
+}
+
+static uint64_t read32( const unsigned char* p )
+{
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24;
+}
+
+static uint64_t read64( const unsigned char* p )
+{
+	return read32( p ) | read32( p + 4 ) << 32;
+}
+
+static float readFloat( const unsigned char* p )
+{
+	uint32_t bits = (uint32_t)read32( p );
+	float value;
+
+	memcpy( &value, &bits, sizeof(value) );
+
+	return value;
+}
+
+/**
+ * Read a varint at *p, no further than end, and move *p past it.
+ *
+ * Return 1 if successful, 0 if the varint runs past end.
+ */
+static int readVarint( const unsigned char** p, const unsigned char* end, uint64_t* value )
+{
+	uint64_t result = 0;
+	int shift = 0;
+
+	while( *p < end && shift < 64 )
+	{
+		unsigned char byte = *( *p )++;
+
+		result |= (uint64_t)( byte & 0x7F ) << shift;
+
+		if( !( byte & 0x80 ) )
+		{
+			*value = result;
+			return 1;
+		}
+
+		shift += 7;
+	}
+
+	return 0;
+}
+
+/**
+ * Return the least float that is at least value, so that a stored bound
+ * still holds for the weights computed from it in double.
+ */
+static float roundUp( double value )
+{
+	float rounded = (float)value;
+
+	if( (double)rounded < value )
+	{
+		rounded = nextafterf( rounded, INFINITY );
+	}
+
+	return rounded;
+}
+
+/**
+ * Return the null-terminated text of the term with the given entry, or NULL
+ * if the entry points outside the strings section or at bytes that are not
+ * null-terminated where it says, as in a damaged index.
+ */
+static const char* termString( BinaryIndexPtr index, struct BITermEntry* entry )
+{
+	uint64_t section = index->header.lengths_offset - index->header.strings_offset;
+	const char* strings = (const char*)index->data + index->header.strings_offset;
+
+	if( entry->string_offset >= section || entry->string_length >= section - entry->string_offset
+		|| strings[entry->string_offset + entry->string_length] != '\0' )
+	{
+		return NULL;
+	}
+
+	return strings + entry->string_offset;
+}
+
+static void writeBytes( BIWriterPtr writer, const void* bytes, size_t length )
+{
+	fwrite( bytes, 1, length, writer->file );
+	writer->position += length;
+}
+
+static void writeFloat( BIWriterPtr writer, float value )
+{
+	uint32_t bits;
+
+	memcpy( &bits, &value, sizeof(bits) );
+	write32( writer, bits );
+}
+
+/**
+ * Write zero bytes up to the next 8-byte boundary.
+ */
+static void writePadding( BIWriterPtr writer )
+{
+	while( writer->position % 8 != 0 )
+	{
+		putc( 0, writer->file );
+		writer->position++;
+	}
+}
+
+static void write32( BIWriterPtr writer, uint64_t value )
+{
+	int i;
+
+	for( i = 0; i < 4; i++ )
+	{
+		putc( (int)( ( value >> ( i * 8 ) ) & 0xFF ), writer->file );
+	}
+
+	writer->position += 4;
+}
+
+static void write64( BIWriterPtr writer, uint64_t value )
+{
+	write32( writer, value & 0xFFFFFFFF );
+	write32( writer, value >> 32 );
+}
+
+static void writeVarint( BIWriterPtr writer, uint64_t value )
+{
+	while( value >= 0x80 )
+	{
+		putc( (int)( ( value & 0x7F ) | 0x80 ), writer->file );
+		value >>= 7;
+		writer->position++;
+	}
+
+	putc( (int)value, writer->file );
+	writer->position++;
+}
+
+BIWriterPtr BICreate( char* file_path, size_t* lengths, size_t file_count )
+{
+	BIWriterPtr writer = calloc( 1, sizeof(*writer) );
+	size_t i;
+
+	if( writer == NULL )
+	{
+		return NULL;
+	}
+
+	writer->lengths = lengths;
+	writer->file_count = file_count;
+
+	for( i = 0; i < file_count; i++ )
+	{
+		writer->average_length += lengths[i];
+		writer->ranked_count += lengths[i] > 0;
+	}
+
+	if( writer->ranked_count > 0 )
+	{
+		writer->average_length /= writer->ranked_count;
+	}
+
+	writer->file = fopen( file_path, "wb" );
+	writer->buffer = malloc( BI_BUFFER_SIZE );
+
+	if( writer->file == NULL || writer->buffer == NULL )
+	{
+		if( writer->file != NULL )
+		{
+			fclose( writer->file );
+		}
+		free( writer->buffer );
+		free( writer );
+		return NULL;
+	}
+
+	setvbuf( writer->file, writer->buffer, _IOFBF, BI_BUFFER_SIZE );
+
+	/* The header is written last, once the sections' offsets are known. */
+	static const unsigned char header[BI_HEADER_SIZE];
+	writeBytes( writer, header, sizeof(header) );
+
+	return writer;
+}
+
+int BIWrite( BIWriterPtr writer, const char* term, size_t term_length, PostingPtr postings, size_t count )
+{
+	size_t i;
+
+	for( i = 1; i < count; i++ )
+	{
+		if( postings[i].file_id < postings[i - 1].file_id )
+		{
+			qsort( postings, count, sizeof(*postings), compareFileIDs );
+			break;
+		}
+	}
+
+	if( !appendTerm( writer, term, term_length, count ) )
+	{
+		return 0;
+	}
+
+	/*
+	 * The directory needs each block's encoded size and greatest weight, so
+	 * the blocks are measured and weighed before any is written.
+	 */
+	size_t block_count = ( count + BI_BLOCK_SIZE - 1 ) / BI_BLOCK_SIZE;
+	double idf = BM25IDF( count, writer->ranked_count );
+	double term_max = 0;
+	double block_max = 0;
+	uint64_t end = 0;
+	int64_t previous = -1;
+
+	for( i = 0; i < count; i++ )
+	{
+		double weight = BM25Weight( idf, postings[i].appearances, writer->lengths[postings[i].file_id], writer->average_length );
+
+		if( weight > block_max )
+		{
+			block_max = weight;
+		}
+
+		if( block_count > 1 )
+		{
+			uint64_t values[2] = { (uint64_t)( postings[i].file_id - previous ), postings[i].appearances };
+			int v;
+
+			for( v = 0; v < 2; v++ )
+			{
+				do
+				{
+					end++;
+					values[v] >>= 7;
+				} while( values[v] != 0 );
+			}
+
+			previous = postings[i].file_id;
+		}
+
+		if( ( i + 1 ) % BI_BLOCK_SIZE == 0 || i + 1 == count )
+		{
+			if( block_count > 1 )
+			{
+				write32( writer, postings[i].file_id );
+				write32( writer, end );
+				writeFloat( writer, roundUp( block_max ) );
+			}
+
+			if( block_max > term_max )
+			{
+				term_max = block_max;
+			}
+			block_max = 0;
+		}
+	}
+
+	writer->terms[writer->term_count - 1].max_weight = roundUp( term_max );
+	previous = -1;
+
+	for( i = 0; i < count; i++ )
+	{
+		writeVarint( writer, (uint64_t)( postings[i].file_id - previous ) );
+		writeVarint( writer, postings[i].appearances );
+		previous = postings[i].file_id;
+	}
+
+	return !ferror( writer->file );
+}
+
+int BIFinish( BIWriterPtr writer, char** paths )
+{
+	size_t path_count = writer->file_count;
+	struct BIHeader header;
+	size_t i;
+
+	header.version = BI_VERSION;
+	header.block_size = BI_BLOCK_SIZE;
+	header.term_count = writer->term_count;
+	header.file_count = path_count;
+	header.postings_offset = BI_HEADER_SIZE;
+
+	writePadding( writer );
+	header.terms_offset = writer->position;
+
+	for( i = 0; i < writer->term_count; i++ )
+	{
+		write64( writer, writer->terms[i].string_offset );
+		write64( writer, writer->terms[i].postings_offset );
+		write32( writer, writer->terms[i].string_length );
+		write32( writer, writer->terms[i].posting_count );
+		writeFloat( writer, writer->terms[i].max_weight );
+		write32( writer, 0 );
+	}
+
+	header.strings_offset = writer->position;
+	if( writer->strings_length > 0 )
+	{
+		writeBytes( writer, writer->strings, writer->strings_length );
+	}
+
+	writePadding( writer );
+	header.lengths_offset = writer->position;
+	header.total_length = 0;
+
+	for( i = 0; i < path_count; i++ )
+	{
+		write64( writer, writer->lengths[i] );
+		header.total_length += writer->lengths[i];
+	}
+
+	header.paths_offset = writer->position;
+
+	uint64_t offset = 0;
+
+	for( i = 0; i < path_count; i++ )
+	{
+		write64( writer, offset );
+		offset += strlen( paths[i] ) + 1;
+	}
+	write64( writer, offset );
+
+	for( i = 0; i < path_count; i++ )
+	{
+		writeBytes( writer, paths[i], strlen( paths[i] ) + 1 );
+	}
+
+	header.file_size = writer->position;
+
+	int successful = !ferror( writer->file ) && fseek( writer->file, 0, SEEK_SET ) == 0;
+
+	if( successful )
+	{
+		writeBytes( writer, BI_MAGIC, 8 );
+		write32( writer, header.version );
+		write32( writer, header.block_size );
+		write64( writer, header.term_count );
+		write64( writer, header.file_count );
+		write64( writer, header.postings_offset );
+		write64( writer, header.terms_offset );
+		write64( writer, header.strings_offset );
+		write64( writer, header.lengths_offset );
+		write64( writer, header.paths_offset );
+		write64( writer, header.total_length );
+		write64( writer, header.file_size );
+		successful = !ferror( writer->file );
+	}
+
+	/* The buffer is only freed once fclose has flushed it. */
+	if( fclose( writer->file ) != 0 )
+	{
+		successful = 0;
+	}
+
+	free( writer->terms );
+	free( writer->strings );
+	free( writer->buffer );
+	free( writer );
+
+	return successful;
+}
+
+BinaryIndexPtr BIOpen( char* file_path )
+{
+	BinaryIndexPtr index = calloc( 1, sizeof(*index) );
+
+	if( index == NULL )
+	{
+		return NULL;
+	}
+
+	index->contents = FMOpen( file_path );
+
+	if( index->contents == NULL || index->contents->length < BI_HEADER_SIZE
+		|| memcmp( index->contents->data, BI_MAGIC, 8 ) != 0 )
+	{
+		BIClose( index );
+		return NULL;
+	}
+
+	const unsigned char* p = (const unsigned char*)index->contents->data;
+	struct BIHeader* header = &index->header;
+
+	index->data = p;
+	header->version = (uint32_t)read32( p + 8 );
+	header->block_size = (uint32_t)read32( p + 12 );
+	header->term_count = read64( p + 16 );
+	header->file_count = read64( p + 24 );
+	header->postings_offset = read64( p + 32 );
+	header->terms_offset = read64( p + 40 );
+	header->strings_offset = read64( p + 48 );
+	header->lengths_offset = read64( p + 56 );
+	header->paths_offset = read64( p + 64 );
+	header->total_length = read64( p + 72 );
+	header->file_size = read64( p + 80 );
+
+	/* Each section must start after the one before it, and hold what the header says it does. */
+	if( header->version != BI_VERSION || header->block_size == 0
+		|| header->file_size != index->contents->length
+		|| header->postings_offset != BI_HEADER_SIZE
+		|| header->terms_offset < header->postings_offset
+		|| header->term_count > ( header->file_size - header->terms_offset ) / BI_TERM_ENTRY_SIZE
+		|| header->strings_offset != header->terms_offset + header->term_count * BI_TERM_ENTRY_SIZE
+		|| header->lengths_offset < header->strings_offset || header->paths_offset > header->file_size
+		|| header->paths_offset < header->lengths_offset
+		|| header->file_count > ( header->paths_offset - header->lengths_offset ) / 8
+		|| header->file_count >= ( header->file_size - header->paths_offset ) / 8 )
+	{
+		BIClose( index );
+		return NULL;
+	}
+
+	uint64_t path_bytes = header->file_size - header->paths_offset - ( header->file_count + 1 ) * 8;
+
+	/* With the file ending in a null byte, any path that starts inside the path bytes ends inside them too. */
+	if( read64( p + header->paths_offset + header->file_count * 8 ) > path_bytes
+		|| ( header->file_count > 0 && ( path_bytes == 0 || p[header->file_size - 1] != '\0' ) ) )
+	{
+		BIClose( index );
+		return NULL;
+	}
+
+	return index;
+}
+
+size_t BIFind( BinaryIndexPtr index, const char* term, size_t length )
+{
+	size_t low = 0;
+	size_t high = index->header.term_count;
+
+	/* The terms are in descending order. */
+	while( low < high )
+	{
+		size_t middle = low + ( high - low ) / 2;
+		struct BITermEntry entry = BITerm( index, middle );
+		const char* string = termString( index, &entry );
+
+		/* A damaged entry leaves the order unknown, so the term cannot be found. */
+		if( string == NULL )
+		{
+			return BI_NOT_FOUND;
+		}
+
+		int order = compareTerm( string, entry.string_length, term, length );
+
+		if( order == 0 )
+		{
+			return middle;
+		}
+
+		if( order > 0 )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return BI_NOT_FOUND;
+}
+
+struct BITermEntry BITerm( BinaryIndexPtr index, size_t position )
+{
+	const unsigned char* p = index->data + index->header.terms_offset + position * BI_TERM_ENTRY_SIZE;
+	struct BITermEntry entry;
+
+	entry.string_offset = read64( p );
+	entry.postings_offset = read64( p + 8 );
+	entry.string_length = (uint32_t)read32( p + 16 );
+	entry.posting_count = (uint32_t)read32( p + 20 );
+	entry.max_weight = readFloat( p + 24 );
+
+	return entry;
+}
+
+const char* BITermString( BinaryIndexPtr index, size_t position )
+{
+	struct BITermEntry entry = BITerm( index, position );
+
+	return termString( index, &entry );
+}
+
+const unsigned char* BIPostings( BinaryIndexPtr index, size_t position, size_t* length )
+{
+	uint64_t section = index->header.terms_offset - index->header.postings_offset;
+	uint64_t start = BITerm( index, position ).postings_offset;
+	uint64_t end = position + 1 < index->header.term_count ? BITerm( index, position + 1 ).postings_offset : section;
+
+	/* A damaged entry yields no postings rather than bytes outside the section. */
+	if( end > section || start > end )
+	{
+		*length = 0;
+		return index->data + index->header.postings_offset;
+	}
+
+	*length = end - start;
+	return index->data + index->header.postings_offset + start;
+}
+
+size_t BIDecode( BinaryIndexPtr index, size_t position, PostingPtr items )
+{
+	size_t length;
+	const unsigned char* p = BIPostings( index, position, &length );
+	const unsigned char* end = p + length;
+	size_t count = BITerm( index, position ).posting_count;
+	size_t block_count = ( count + index->header.block_size - 1 ) / index->header.block_size;
+	int64_t previous = -1;
+	size_t i;
+
+	if( block_count > 1 )
+	{
+		if( length < block_count * BI_DIRECTORY_ENTRY_SIZE )
+		{
+			return 0;
+		}
+
+		p += block_count * BI_DIRECTORY_ENTRY_SIZE;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		uint64_t delta;
+		uint64_t appearances;
+
+		if( !readVarint( &p, end, &delta ) || !readVarint( &p, end, &appearances ) )
+		{
+			break;
+		}
+
+		previous += (int64_t)delta;
+		items[i].file_id = (uint32_t)previous;
+		items[i].appearances = (size_t)appearances;
+	}
+
+	return i;
+}
+
+int BIOpenCursor( BinaryIndexPtr index, size_t position, BICursorPtr cursor )
+{
+	size_t length;
+
+	cursor->data = BIPostings( index, position, &length );
+	cursor->end = cursor->data + length;
+	struct BITermEntry entry = BITerm( index, position );
+
+	cursor->count = entry.posting_count;
+	cursor->max_weight = entry.max_weight;
+	cursor->block_size = index->header.block_size;
+	cursor->block_count = ( cursor->count + cursor->block_size - 1 ) / cursor->block_size;
+	cursor->directory = NULL;
+
+	if( cursor->block_count > 1 )
+	{
+		if( length < cursor->block_count * BI_DIRECTORY_ENTRY_SIZE )
+		{
+			cursor->block_count = 0;
+			return 0;
+		}
+
+		cursor->directory = cursor->data;
+		cursor->data += cursor->block_count * BI_DIRECTORY_ENTRY_SIZE;
+	}
+
+	return 1;
+}
+
+uint32_t BIBlockLast( BICursorPtr cursor, size_t block )
+{
+	if( cursor->directory == NULL )
+	{
+		return UINT32_MAX;
+	}
+
+	return (uint32_t)read32( cursor->directory + block * BI_DIRECTORY_ENTRY_SIZE );
+}
+
+float BIBlockMax( BICursorPtr cursor, size_t block )
+{
+	if( cursor->directory == NULL )
+	{
+		return cursor->max_weight;
+	}
+
+	return readFloat( cursor->directory + block * BI_DIRECTORY_ENTRY_SIZE + 8 );
+}
+
+size_t BIDecodeBlock( BICursorPtr cursor, size_t block, uint32_t* ids, size_t* appearances )
+{
+	const unsigned char* p = cursor->data;
+	const unsigned char* end = cursor->end;
+	int64_t previous = -1;
+
+	if( cursor->directory != NULL )
+	{
+		if( block > 0 )
+		{
+			previous = BIBlockLast( cursor, block - 1 );
+			p = cursor->data + read32( cursor->directory + ( block - 1 ) * BI_DIRECTORY_ENTRY_SIZE + 4 );
+		}
+
+		end = cursor->data + read32( cursor->directory + block * BI_DIRECTORY_ENTRY_SIZE + 4 );
+
+		if( end > cursor->end || p > end )
+		{
+			return 0;
+		}
+	}
+
+	size_t count = cursor->count - block * cursor->block_size;
+	size_t i;
+
+	if( count > cursor->block_size )
+	{
+		count = cursor->block_size;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		uint64_t delta;
+		uint64_t value;
+
+		if( !readVarint( &p, end, &delta ) || !readVarint( &p, end, &value ) )
+		{
+			break;
+		}
+
+		previous += (int64_t)delta;
+		ids[i] = (uint32_t)previous;
+
+		if( appearances != NULL )
+		{
+			appearances[i] = (size_t)value;
+		}
+	}
+
+	return i;
+}
+
+const char* BIPath( BinaryIndexPtr index, uint32_t file_id )
+{
+	if( file_id >= index->header.file_count )
+	{
+		return NULL;
+	}
+
+	const unsigned char* offsets = index->data + index->header.paths_offset;
+	const unsigned char* bytes = offsets + ( index->header.file_count + 1 ) * 8;
+	uint64_t path_bytes = index->header.file_size - index->header.paths_offset - ( index->header.file_count + 1 ) * 8;
+	uint64_t offset = read64( offsets + (size_t)file_id * 8 );
+
+	/* BIOpen made sure that the path bytes end in a null byte. */
+	if( offset >= path_bytes )
+	{
+		return NULL;
+	}
+
+	return (const char*)bytes + offset;
+}
+
+uint64_t BILength( BinaryIndexPtr index, uint32_t file_id )
+{
+	if( file_id >= index->header.file_count )
+	{
+		return 0;
+	}
+
+	return read64( index->data + index->header.lengths_offset + (size_t)file_id * 8 );
+}
+
+void BIClose( BinaryIndexPtr index )
+{
+	if( index == NULL )
+	{
+		return;
+	}
+
+	if( index->contents != NULL )
+	{
+		FMClose( index->contents );
+	}
+
+	free( index );
+}
@@ -0,0 +1,273 @@
+#ifndef index_binary_index_h
+#define index_binary_index_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "file-map.h"
+#include "postings.h"
+
+/*
+ * binary-index.h
+ *
+ * A binary form of the inverted index, laid out so that a reader can map the
+ * file and look a term up without parsing the rest.  All integers are
+ * little-endian, and every section starts on an 8-byte boundary:
+ *
+ *   header    struct BIHeader, fixed size, with the sections' offsets
+ *   postings  each term's postings, in the order of the term entries
+ *   terms     term_count struct BITermEntry, in descending strcmp order of
+ *             term, as in the text index
+ *   strings   the terms' bytes, each followed by a null byte
+ *   lengths   file_count 64-bit numbers of tokens, one per file
+ *   paths     file_count + 1 64-bit offsets into the path bytes, which
+ *             follow them; each path is followed by a null byte.  A file's
+ *             position in the table is its ID.
+ *
+ * A term's postings are in ascending file ID order, in blocks of
+ * BI_BLOCK_SIZE.  Each posting is a varint difference from the previous file
+ * ID (from -1 for the term's first) and a varint number of appearances.  A
+ * term with more than one block starts with a directory of
+ * BI_DIRECTORY_ENTRY_SIZE bytes per block: the block's last file ID, the
+ * offset just past the block from the end of the directory, both 32-bit,
+ * and the most the term weighs in any file of the block, as a 32-bit float.
+ * The directory lets a reader skip whole blocks without decoding them, by
+ * file ID or, in a ranked query, by weight.  The term entry holds the most
+ * the term weighs in any file.  Weights are BM25's (see bm25.h), rounded up,
+ * over only the files with at least one token, as a text index cannot know
+ * of the others.
+ */
+
+#define BI_MAGIC "IDXBIN\r\n"
+#define BI_VERSION 2
+
+/* The number of postings per block. */
+#define BI_BLOCK_SIZE 128
+
+/* The stdio buffer size of the writer. */
+#define BI_BUFFER_SIZE (1024 * 1024)
+
+/* The size of the header, of a term entry and of a block directory entry, in the file. */
+#define BI_HEADER_SIZE 88
+#define BI_TERM_ENTRY_SIZE 32
+#define BI_DIRECTORY_ENTRY_SIZE 12
+
+/*
+ * The header, as read from or to be written to a file.
+ */
+struct BIHeader
+{
+	uint32_t version;
+	uint32_t block_size;
+	uint64_t term_count;
+	uint64_t file_count;
+	uint64_t postings_offset;
+	uint64_t terms_offset;
+	uint64_t strings_offset;
+	uint64_t lengths_offset;
+	uint64_t paths_offset;
+
+	/* The number of tokens in all the files together. */
+	uint64_t total_length;
+
+	uint64_t file_size;
+};
+
+/*
+ * A term entry, as read from or to be written to a file.  The offsets are
+ * from the start of the strings and postings sections.  A term's postings
+ * end where the next term's start, or at the end of the section.
+ */
+struct BITermEntry
+{
+	uint64_t string_offset;
+	uint64_t postings_offset;
+	uint32_t string_length;
+	uint32_t posting_count;
+	float max_weight;
+};
+
+struct BIWriter
+{
+	FILE* file;
+	char* buffer;
+
+	/* The number of bytes written so far. */
+	uint64_t position;
+
+	/* The number of tokens in each file, by which the weights are scaled. */
+	size_t* lengths;
+	size_t file_count;
+
+	/* The number of files with any tokens, and their average length, which BM25 weighs against. */
+	size_t ranked_count;
+	double average_length;
+
+	/* The terms written so far; the dictionary is kept in memory and written by BIFinish. */
+	struct BITermEntry* terms;
+	size_t term_count;
+	size_t term_capacity;
+	char* strings;
+	size_t strings_length;
+	size_t strings_capacity;
+};
+typedef struct BIWriter* BIWriterPtr;
+
+/*
+ * A binary index opened for reading.
+ */
+struct BinaryIndex
+{
+	FileContentsPtr contents;
+	const unsigned char* data;
+	struct BIHeader header;
+};
+typedef struct BinaryIndex* BinaryIndexPtr;
+
+/*
+ * A term's postings, read a block at a time (see BIOpenCursor).
+ */
+struct BICursor
+{
+	/* The block directory, or NULL if the postings fit in one block. */
+	const unsigned char* directory;
+
+	/* The first block, and the end of the postings. */
+	const unsigned char* data;
+	const unsigned char* end;
+
+	size_t count;
+	size_t block_count;
+	size_t block_size;
+
+	/* The term's greatest weight. */
+	float max_weight;
+};
+typedef struct BICursor* BICursorPtr;
+
+/* BIFind's result for a term that is not in the index. */
+#define BI_NOT_FOUND ( (size_t)-1 )
+
+/*
+ * BICreate creates a new, empty binary index at file_path, of file_count
+ * files whose numbers of tokens are lengths.  lengths must stay valid until
+ * BIFinish.
+ *
+ * If the function succeeds, it returns a non-NULL BIWriterPtr.
+ * Else it returns NULL.
+ */
+BIWriterPtr BICreate( char* file_path, size_t* lengths, size_t file_count );
+
+/*
+ * BIWrite appends a term and its count postings, in any order, to the index.
+ * The postings are put in file ID order in place.  Terms must be written in
+ * descending strcmp order.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int BIWrite( BIWriterPtr writer, const char* term, size_t term_length, PostingPtr postings, size_t count );
+
+/*
+ * BIFinish writes the dictionary, the file lengths and the file table of
+ * the file_count paths, then the header, and destroys the writer.
+ *
+ * If every byte of the index was written, it returns 1.  Else, it returns 0.
+ */
+int BIFinish( BIWriterPtr writer, char** paths );
+
+/*
+ * BIOpen maps the binary index at file_path and checks that its sections
+ * fit in the file.
+ *
+ * If the function succeeds, it returns a non-NULL BinaryIndexPtr.
+ * Else it returns NULL.
+ */
+BinaryIndexPtr BIOpen( char* file_path );
+
+/*
+ * BIFind looks up the length bytes at term with a binary search of the
+ * dictionary.
+ *
+ * Returns the term's position in the dictionary, or BI_NOT_FOUND.
+ */
+size_t BIFind( BinaryIndexPtr index, const char* term, size_t length );
+
+/*
+ * BITerm reads the entry of the term at the given position in the dictionary.
+ */
+struct BITermEntry BITerm( BinaryIndexPtr index, size_t position );
+
+/*
+ * BITermString returns the null-terminated text of the term at the given
+ * position in the dictionary, or NULL if the index is damaged there.
+ */
+const char* BITermString( BinaryIndexPtr index, size_t position );
+
+/*
+ * BIPostings returns the encoded postings of the term at the given position
+ * in the dictionary, and stores their length in bytes in *length.
+ */
+const unsigned char* BIPostings( BinaryIndexPtr index, size_t position, size_t* length );
+
+/*
+ * BIDecode writes the postings of the term at the given position in the
+ * dictionary, in file ID order, to items, which must have room for the
+ * term's posting_count.
+ *
+ * Returns the number of postings decoded, which is less than posting_count
+ * only if the index is damaged.
+ */
+size_t BIDecode( BinaryIndexPtr index, size_t position, PostingPtr items );
+
+/*
+ * BIOpenCursor sets cursor up to read the postings of the term at the given
+ * position in the dictionary block by block, so that blocks can be skipped
+ * by their last file ID without being decoded.
+ *
+ * If the term's block directory fits in its postings, it returns 1.  Else,
+ * it returns 0.
+ */
+int BIOpenCursor( BinaryIndexPtr index, size_t position, BICursorPtr cursor );
+
+/*
+ * BIBlockLast returns the last file ID in the given block of cursor's
+ * postings, from the block directory, or UINT32_MAX if the postings are a
+ * single block, which has no directory.
+ */
+uint32_t BIBlockLast( BICursorPtr cursor, size_t block );
+
+/*
+ * BIBlockMax returns the most the term weighs in any file of the given
+ * block of cursor's postings, or in any file at all if the postings are a
+ * single block.
+ */
+float BIBlockMax( BICursorPtr cursor, size_t block );
+
+/*
+ * BIDecodeBlock writes the file IDs in the given block of cursor's postings
+ * to ids, and their appearances to appearances unless it is NULL.  Each
+ * must have room for block_size postings.
+ *
+ * Returns the number of postings decoded, which is less than the block
+ * holds only if the index is damaged.
+ */
+size_t BIDecodeBlock( BICursorPtr cursor, size_t block, uint32_t* ids, size_t* appearances );
+
+/*
+ * BIPath returns the null-terminated path of the file with the given ID, or
+ * NULL if there is no such file or the index is damaged there.
+ */
+const char* BIPath( BinaryIndexPtr index, uint32_t file_id );
+
+/*
+ * BILength returns the number of tokens in the file with the given ID, or 0
+ * if there is no such file.
+ */
+uint64_t BILength( BinaryIndexPtr index, uint32_t file_id );
+
+/*
+ * BIClose unmaps the index and destroys it.
+ */
+void BIClose( BinaryIndexPtr index );
+
+#endif
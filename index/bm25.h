@@ -0,0 +1,48 @@
+#ifndef index_bm25_h
+#define index_bm25_h
+
+#include <math.h>
+#include <stddef.h>
+
+/*
+ * bm25.h
+ *
+ * Okapi BM25, the score by which ranked queries order files.  A term's
+ * weight in a file grows with its number of appearances there, but ever
+ * more slowly, and is scaled down in files longer than average and up for
+ * terms that few files contain.  A file's score is the sum of its query
+ * terms' weights.
+ *
+ * The binary index stores upper bounds of these weights, computed when it
+ * is written, so the constants are part of its format.
+ */
+
+/* How quickly a term's weight saturates with its appearances. */
+#define BM25_K1 1.2
+
+/* How much a file's length scales its weights, from 0 for not at all to 1 for fully. */
+#define BM25_B 0.75
+
+/*
+ * BM25IDF returns the inverse document frequency of a term that count of
+ * file_count files contain, which is always positive.
+ */
+static inline double BM25IDF( size_t count, size_t file_count )
+{
+	return log( 1.0 + ( (double)file_count - (double)count + 0.5 ) / ( (double)count + 0.5 ) );
+}
+
+/*
+ * BM25Weight returns the weight of a term whose inverse document frequency
+ * is idf in a file of length tokens, where it appears appearances times,
+ * when files average average_length tokens.
+ */
+static inline double BM25Weight( double idf, size_t appearances, size_t length, double average_length )
+{
+	double tf = (double)appearances;
+	double norm = 1.0 - BM25_B + ( average_length > 0 ? BM25_B * (double)length / average_length : 0 );
+
+	return idf * tf * ( BM25_K1 + 1.0 ) / ( tf + BM25_K1 * norm );
+}
+
+#endif
@@ -0,0 +1,176 @@
+/*
+ * char-class.c
+ */
+#include <stdint.h>
+#include "char-class.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CC_HAVE_X86 1
+#endif
+
+const unsigned char token_class[256] = {
+	['0' ... '9'] = 1,
+	['A' ... 'Z'] = 1,
+	['a' ... 'z'] = 1,
+};
+
+/* A scan kernel returns the first byte in [position, end) whose class is want_token. */
+typedef char* (*ScanKernel)(char* position, char* end, int want_token);
+
+static char* scan_scalar(char* position, char* end, int want_token);
+static ScanKernel scan_kernel = scan_scalar;
+static const char* scan_kernel_name = "scalar";
+
+static char* scan_scalar(char* position, char* end, int want_token) {
+
+	/*
+	 * Description: one byte at a time scan against token_class; also finishes the tail of the vector scans
+	 * Parameters: first byte to examine, one past the last byte, 1 to find a token character or 0 to find a delimiter
+	 * Modifies: nothing
+	 * Returns: pointer to the first matching byte, or end
+	 */
+
+	while(position < end && token_class[(unsigned char)*position] != want_token) {
+		position++;
+	}
+
+	return position;
+}
+
+#ifdef CC_HAVE_X86
+
+/*
+ * Nibble tables for the AVX2 kernel.  Byte c is a token character iff
+ * (nibble_lo[c & 0xF] & nibble_hi[c >> 4]) != 0.  They are derived from
+ * token_class at startup, which works as long as every token character is
+ * below 0x80 (the high nibble then indexes one of eight bits).
+ */
+static unsigned char nibble_lo[16];
+static unsigned char nibble_hi[16];
+
+__attribute__((target("avx2")))
+static char* scan_avx2(char* position, char* end, int want_token) {
+
+	/*
+	 * Description: classifies 32 bytes per step with two vpshufb lookups and jumps to the first match with a count of trailing zeros
+	 * Parameters: first byte to examine, one past the last byte, 1 to find a token character or 0 to find a delimiter
+	 * Modifies: nothing
+	 * Returns: pointer to the first matching byte, or end
+	 */
+
+	const __m256i lo_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibble_lo));
+	const __m256i hi_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibble_hi));
+	const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+	const __m256i zero = _mm256_setzero_si256();
+	const uint32_t invert = want_token ? 0xFFFFFFFFu : 0;
+
+	while(end - position >= 32) {
+		__m256i bytes = _mm256_loadu_si256((const __m256i*)position);
+		__m256i lo = _mm256_and_si256(bytes, low_nibble);
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), low_nibble);
+		__m256i hits = _mm256_and_si256(_mm256_shuffle_epi8(lo_table, lo), _mm256_shuffle_epi8(hi_table, hi));
+
+		/* Bits are set for delimiters; flip them when searching for a token character. */
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(hits, zero)) ^ invert;
+
+		if(mask != 0) {
+			return position + __builtin_ctz(mask);
+		}
+		position += 32;
+	}
+
+	return scan_scalar(position, end, want_token);
+}
+
+#ifdef __SSE2__
+
+static char* scan_sse2(char* position, char* end, int want_token) {
+
+	/*
+	 * Description: classifies 16 bytes per step with range comparisons equivalent to token_class ([0-9A-Za-z])
+	 * Parameters: first byte to examine, one past the last byte, 1 to find a token character or 0 to find a delimiter
+	 * Modifies: nothing
+	 * Returns: pointer to the first matching byte, or end
+	 */
+
+	/* SSE2 only compares signed bytes, so each range is biased to start at -128. */
+	const __m128i digit_bias = _mm_set1_epi8((char)(0x80 - '0'));
+	const __m128i digit_limit = _mm_set1_epi8((char)(-128 + 10));
+	const __m128i alpha_bias = _mm_set1_epi8((char)(0x80 - 'a'));
+	const __m128i alpha_limit = _mm_set1_epi8((char)(-128 + 26));
+	const __m128i fold_case = _mm_set1_epi8(0x20);
+	const uint32_t invert = want_token ? 0 : 0xFFFF;
+
+	while(end - position >= 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i*)position);
+		__m128i digit = _mm_cmplt_epi8(_mm_add_epi8(bytes, digit_bias), digit_limit);
+		__m128i alpha = _mm_cmplt_epi8(_mm_add_epi8(_mm_or_si128(bytes, fold_case), alpha_bias), alpha_limit);
+
+		/* Bits are set for token characters; flip them when searching for a delimiter. */
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(digit, alpha)) ^ invert;
+
+		if(mask != 0) {
+			return position + __builtin_ctz(mask);
+		}
+		position += 16;
+	}
+
+	return scan_scalar(position, end, want_token);
+}
+
+#endif
+
+__attribute__((constructor))
+static void select_scan_kernel(void) {
+
+	/*
+	 * Description: picks the widest scan kernel the running CPU supports
+	 * Parameters: none
+	 * Modifies: scan_kernel, scan_kernel_name, nibble tables
+	 * Returns: nothing
+	 */
+
+	int c;
+	int nibbles_usable = 1;
+
+	for(c = 0; c < 256; c++) {
+		if(token_class[c]) {
+			if(c >= 0x80) {
+				nibbles_usable = 0;
+				break;
+			}
+			nibble_lo[c & 0x0F] |= (unsigned char)(1 << (c >> 4));
+		}
+	}
+	for(c = 0; c < 8; c++) {
+		nibble_hi[c] = (unsigned char)(1 << c);
+	}
+
+	__builtin_cpu_init();
+
+	if(nibbles_usable && __builtin_cpu_supports("avx2")) {
+		scan_kernel = scan_avx2;
+		scan_kernel_name = "avx2";
+		return;
+	}
+
+#ifdef __SSE2__
+	scan_kernel = scan_sse2;
+	scan_kernel_name = "sse2";
+#endif
+}
+
+#endif
+
+char* CCScanToToken(char* position, char* end) {
+	return scan_kernel(position, end, 1);
+}
+
+char* CCScanToDelimiter(char* position, char* end) {
+	return scan_kernel(position, end, 0);
+}
+
+const char* CCKernelName(void) {
+	return scan_kernel_name;
+}
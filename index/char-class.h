@@ -0,0 +1,64 @@
+#ifndef index_char_class_h
+#define index_char_class_h
+
+#include <stdint.h>
+
+/*
+ * char-class.h
+ *
+ * Classification of input bytes into token characters and delimiters, and
+ * vectorized scans over runs of either class.  The scans are selected once at
+ * startup according to the features of the running CPU (AVX2, then SSE2,
+ * then a portable scalar loop).
+ */
+
+/*
+ * Character-class table: entry c is 1 if byte c may appear in a token
+ * (i.e. it is alphanumeric in the C locale), 0 if it is a delimiter.
+ */
+extern const unsigned char token_class[256];
+
+/*
+ * Description: classifies the eight bytes of word at once with SWAR range checks equivalent to token_class ([0-9A-Za-z])
+ * Parameters: eight bytes of input, loaded as one word
+ * Modifies: nothing
+ * Returns: a word in which the high bit of each byte is set if that byte is a token character, and every other bit is clear
+ */
+static inline uint64_t CCTokenMask(uint64_t word) {
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t high = 0x8080808080808080ULL;
+
+	/* With the high bits cleared no byte can carry into the next, and bytes that had them are dropped at the end. */
+	uint64_t low = word & ~high;
+	uint64_t folded = low | 0x20 * ones;
+	uint64_t digit = (low + (0x80 - '0') * ones) & ~(low + (0x7F - '9') * ones);
+	uint64_t alpha = (folded + (0x80 - 'a') * ones) & ~(folded + (0x7F - 'z') * ones);
+
+	return (digit | alpha) & ~word & high;
+}
+
+/*
+ * Description: scans forward for the first token character
+ * Parameters: first byte to examine, one past the last byte to examine
+ * Modifies: nothing
+ * Returns: pointer to the first token character in [position, end), or end if there is none
+ */
+char* CCScanToToken(char* position, char* end);
+
+/*
+ * Description: scans forward for the first delimiter
+ * Parameters: first byte to examine, one past the last byte to examine
+ * Modifies: nothing
+ * Returns: pointer to the first delimiter in [position, end), or end if there is none
+ */
+char* CCScanToDelimiter(char* position, char* end);
+
+/*
+ * Description: names the scan kernel selected for this CPU
+ * Parameters: none
+ * Modifies: nothing
+ * Returns: "avx2", "sse2" or "scalar"
+ */
+const char* CCKernelName(void);
+
+#endif
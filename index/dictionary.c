@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include "dictionary.h"
+
+/*
+ * Adapts DictWalk's visitor to ArtWalk's, which has no hash to pass on.
+ */
+struct ArtVisit
+{
+	DictVisitFn visit;
+	void* context;
+};
+
+static void visitArtKey( void* visit, const char* key, size_t length, void* value );
+
+static void visitArtKey( void* visit, const char* key, size_t length, void* value )
+{
+	struct ArtVisit* self = visit;
+
+	self->visit( self->context, 0, key, length, value );
+}
+
+DictionaryPtr DictCreate( DictBackend backend )
+{
+	DictionaryPtr dict = calloc( 1, sizeof(*dict) );
+
+	if( dict == NULL )
+	{
+		return NULL;
+	}
+
+	dict->backend = backend;
+
+	if( backend == DICT_ART )
+	{
+		dict->tree = ArtCreate();
+	}
+	else
+	{
+		dict->table = HTCreate();
+	}
+
+	if( dict->tree == NULL && dict->table == NULL )
+	{
+		free( dict );
+		return NULL;
+	}
+
+	return dict;
+}
+
+size_t DictBytes( DictionaryPtr dict )
+{
+	if( dict->backend == DICT_ART )
+	{
+		/* Each key adds a leaf, and at most one inner node where it branches off. */
+		return dict->tree->count * ( sizeof(struct ArtLeaf) + sizeof(struct ArtNode4) );
+	}
+
+	return dict->table->capacity * ( sizeof(struct HashSlot) + 1 );
+}
+
+size_t DictCount( DictionaryPtr dict )
+{
+	return dict->backend == DICT_ART ? dict->tree->count : dict->table->count;
+}
+
+void** DictFind( DictionaryPtr dict, uint64_t hash, const char* key, size_t length )
+{
+	if( dict->backend == DICT_ART )
+	{
+		return ArtFind( dict->tree, key, length );
+	}
+
+	return HTFind( dict->table, hash, key, length );
+}
+
+int DictIsOrdered( DictionaryPtr dict )
+{
+	return dict->backend == DICT_ART;
+}
+
+void** DictPut( DictionaryPtr dict, uint64_t hash, const char* key, size_t length )
+{
+	if( dict->backend == DICT_ART )
+	{
+		return ArtPut( dict->tree, key, length );
+	}
+
+	return HTPut( dict->table, hash, key, length );
+}
+
+void DictWalk( DictionaryPtr dict, DictVisitFn visit, void* context )
+{
+	if( dict->backend == DICT_ART )
+	{
+		struct ArtVisit art_visit = { visit, context };
+
+		ArtWalk( dict->tree, visitArtKey, &art_visit );
+		return;
+	}
+
+	size_t position = 0;
+	HashSlotPtr slot;
+
+	while( ( slot = HTNext( dict->table, &position ) ) != NULL )
+	{
+		visit( context, slot->hash, slot->key, slot->length, slot->value );
+	}
+}
+
+void DictDestroy( DictionaryPtr dict )
+{
+	if( dict == NULL )
+	{
+		return;
+	}
+
+	HTDestroy( dict->table );
+	ArtDestroy( dict->tree );
+	free( dict );
+}
@@ -0,0 +1,111 @@
+#ifndef index_dictionary_h
+#define index_dictionary_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "art.h"
+#include "hash-table.h"
+
+/*
+ * dictionary.h
+ *
+ * The term dictionary of an index: a map from byte strings to pointers, kept
+ * in one of two backends.
+ *
+ *   DICT_HASH  a hash table (see hash-table.h).  Lookups take one hash and
+ *              usually one key comparison, but keys come out in no
+ *              particular order and have to be sorted to be written.
+ *   DICT_ART   an adaptive radix tree (see art.h).  Lookups follow the key
+ *              byte by byte, and ignore the hash, but keys come out already
+ *              in order, and keys sharing a prefix share its storage.
+ *
+ * Every function takes the key's hash (see hash.h), whether or not the
+ * backend uses it, so callers need not care which one they have.  The
+ * backend used when none is asked for can be set at build time by defining
+ * DICT_DEFAULT_BACKEND, e.g. -DDICT_DEFAULT_BACKEND=DICT_ART.
+ *
+ * Keys are not copied: each must stay valid for as long as it is in the
+ * dictionary.
+ */
+
+typedef enum
+{
+	DICT_HASH,
+	DICT_ART
+} DictBackend;
+
+#ifndef DICT_DEFAULT_BACKEND
+#define DICT_DEFAULT_BACKEND DICT_HASH
+#endif
+
+struct Dictionary
+{
+	DictBackend backend;
+
+	/* Only the backend's own structure is used; the other is NULL. */
+	HashTablePtr table;
+	ArtTreePtr tree;
+};
+typedef struct Dictionary* DictionaryPtr;
+
+/*
+ * The function called for each key by DictWalk.
+ */
+typedef void (*DictVisitFn)( void* context, uint64_t hash, const char* key, size_t length, void* value );
+
+/*
+ * DictCreate creates a new, empty dictionary kept in the given backend.
+ *
+ * If the function succeeds, it returns a non-NULL DictionaryPtr.
+ * Else it returns NULL.
+ */
+DictionaryPtr DictCreate( DictBackend backend );
+
+/*
+ * DictBytes returns roughly how much memory the dictionary itself takes, not
+ * counting the keys and values.  For the radix tree it is an upper bound.
+ */
+size_t DictBytes( DictionaryPtr dict );
+
+/*
+ * DictCount returns the number of keys in the dictionary.
+ */
+size_t DictCount( DictionaryPtr dict );
+
+/*
+ * DictFind looks up the length bytes at key, whose hash is hash.
+ *
+ * Returns a pointer to the key's value, or NULL if the key is not in the
+ * dictionary.
+ */
+void** DictFind( DictionaryPtr dict, uint64_t hash, const char* key, size_t length );
+
+/*
+ * DictIsOrdered returns 1 if DictWalk visits the keys in ascending order,
+ * 0 if it visits them in no particular order.
+ */
+int DictIsOrdered( DictionaryPtr dict );
+
+/*
+ * DictPut looks up the length bytes at key, whose hash is hash, adding the
+ * key with a NULL value if it is not in the dictionary yet.
+ *
+ * Returns a pointer to the key's value, or NULL if the key had to be added
+ * and no memory could be allocated.
+ */
+void** DictPut( DictionaryPtr dict, uint64_t hash, const char* key, size_t length );
+
+/*
+ * DictWalk calls visit for every key in the dictionary, in ascending order if
+ * DictIsOrdered says so.  The hash passed to visit is the key's hash for the
+ * hash backend, and 0 for the radix tree, which does not keep hashes.  The
+ * dictionary must not be changed during the walk.
+ */
+void DictWalk( DictionaryPtr dict, DictVisitFn visit, void* context );
+
+/*
+ * DictDestroy destroys the dictionary.  The keys and values are not freed.
+ */
+void DictDestroy( DictionaryPtr dict );
+
+#endif
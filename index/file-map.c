@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "file-map.h"
+
+#define FM_READ_CHUNK (64 * 1024)
+
+static int readAll( int fd, FileContentsPtr contents, size_t size_hint );
+
+/**
+ * Read everything remaining on fd into a heap buffer owned by contents.
+ * size_hint is the expected size of the stream, or 0 if unknown.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int readAll( int fd, FileContentsPtr contents, size_t size_hint )
+{
+	/* One byte past the hint lets the read that finds the end fit without growing the buffer. */
+	size_t capacity = size_hint > 0 ? size_hint + 1 : FM_READ_CHUNK;
+	size_t length = 0;
+	char* buffer = malloc( capacity );
+
+	if( buffer == NULL )
+	{
+		return 0;
+	}
+
+	while( 1 )
+	{
+		/* Grow the buffer once it is full; the hint may have been stale. */
+		if( length == capacity )
+		{
+			char* grown = realloc( buffer, capacity * 2 );
+			if( grown == NULL )
+			{
+				free( buffer );
+				return 0;
+			}
+			buffer = grown;
+			capacity *= 2;
+		}
+
+		ssize_t result = read( fd, buffer + length, capacity - length );
+
+		if( result < 0 )
+		{
+			if( errno == EINTR )
+			{
+				continue;
+			}
+			free( buffer );
+			return 0;
+		}
+
+		if( result == 0 )
+		{
+			break;
+		}
+
+		length += result;
+	}
+
+	if( length == 0 )
+	{
+		free( buffer );
+		buffer = NULL;
+	}
+
+	contents->data = buffer;
+	contents->length = length;
+	contents->is_mapped = 0;
+
+	return 1;
+}
+
+FileContentsPtr FMOpen( char* file_path )
+{
+	int fd = open( file_path, O_RDONLY );
+
+	if( fd < 0 )
+	{
+		return NULL;
+	}
+
+	FileContentsPtr contents = malloc( sizeof(*contents) );
+
+	if( contents == NULL )
+	{
+		close( fd );
+		return NULL;
+	}
+
+	contents->data = NULL;
+	contents->length = 0;
+	contents->is_mapped = 0;
+
+	struct stat info;
+	int successful = 0;
+
+	if( fstat( fd, &info ) == 0 && S_ISREG( info.st_mode ) )
+	{
+		size_t size = info.st_size;
+
+		if( size == 0 )
+		{
+			/* Some special files (e.g. in /proc) report a size of 0 yet have contents. */
+			successful = readAll( fd, contents, 0 );
+		}
+		else if( size < FM_MMAP_THRESHOLD )
+		{
+			successful = readAll( fd, contents, size );
+		}
+		else
+		{
+			void* view = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+
+			if( view != MAP_FAILED )
+			{
+				madvise( view, size, MADV_SEQUENTIAL );
+				contents->data = view;
+				contents->length = size;
+				contents->is_mapped = 1;
+				successful = 1;
+			}
+			else
+			{
+				successful = readAll( fd, contents, size );
+			}
+		}
+	}
+
+	/* Pipes, sockets and devices cannot be mapped; drain them instead. */
+	else
+	{
+		successful = readAll( fd, contents, 0 );
+	}
+
+	close( fd );
+
+	if( !successful )
+	{
+		free( contents );
+		return NULL;
+	}
+
+	return contents;
+}
+
+void FMClose( FileContentsPtr contents )
+{
+	if( contents == NULL )
+	{
+		return;
+	}
+
+	if( contents->is_mapped )
+	{
+		munmap( contents->data, contents->length );
+	}
+	else
+	{
+		free( contents->data );
+	}
+
+	free( contents );
+}
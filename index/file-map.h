@@ -0,0 +1,44 @@
+#ifndef index_file_map_h
+#define index_file_map_h
+
+#include <stddef.h>
+
+/*
+ * Files smaller than this are read into a heap buffer instead of being mapped,
+ * as the mmap/munmap pair and the page faults it incurs cost more than the copy.
+ */
+#define FM_MMAP_THRESHOLD (64 * 1024)
+
+/*
+ * A read-only view of a file's contents.  The data is NOT terminated by '\0';
+ * consumers must rely on length.
+ */
+struct FileContents
+{
+	/* Start of the file's bytes, or NULL if the file is empty. */
+	char* data;
+
+	/* The number of bytes in data. */
+	size_t length;
+
+	/* 1 if data is a mapping that must be munmapped, 0 if it is a heap buffer. */
+	int is_mapped;
+};
+typedef struct FileContents* FileContentsPtr;
+
+/*
+ * FMOpen obtains a read-only view of the file at file_path.  Regular files large
+ * enough to benefit are mapped with mmap and advised for sequential access; pipes,
+ * character devices and other special files are drained with read().
+ *
+ * If the function succeeds, it returns a non-NULL FileContentsPtr.
+ * Else it returns NULL.
+ */
+FileContentsPtr FMOpen( char* file_path );
+
+/*
+ * FMClose releases the view and all memory associated with it.
+ */
+void FMClose( FileContentsPtr contents );
+
+#endif
@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hash-table.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static int allocate( HashTablePtr table, size_t capacity );
+static size_t findSlot( HashTablePtr table, uint64_t hash, const char* key, size_t length );
+static size_t freeSlot( HashTablePtr table, uint64_t hash );
+static uint32_t matchByte( const unsigned char* group, unsigned char byte );
+static uint32_t matchFree( const unsigned char* group );
+static int rehash( HashTablePtr table, size_t capacity );
+static void setControl( HashTablePtr table, size_t slot, unsigned char byte );
+
+/* A slot's control byte when it holds a key with the given hash; the high bit is always clear. */
+#define HASH_TAG( hash ) ( (unsigned char)( (hash) & 0x7F ) )
+
+/* Where a hash's probe sequence starts, from the bits not used by the tag. */
+#define HASH_HOME( hash ) ( (size_t)( (hash) >> 7 ) )
+
+/* findSlot's result when the key is not in the table. */
+#define NOT_FOUND ( (size_t)-1 )
+
+/**
+ * Give table an empty set of capacity slots.
+ *
+ * Return 1 if successful, 0 otherwise, in which case table is unchanged.
+ */
+static int allocate( HashTablePtr table, size_t capacity )
+{
+	unsigned char* control = malloc( capacity + HT_GROUP_SIZE );
+	HashSlotPtr slots = malloc( capacity * sizeof(*slots) );
+
+	if( control == NULL || slots == NULL )
+	{
+		free( control );
+		free( slots );
+		return 0;
+	}
+
+	memset( control, HT_EMPTY, capacity + HT_GROUP_SIZE );
+
+	table->control = control;
+	table->slots = slots;
+	table->capacity = capacity;
+	table->count = 0;
+	table->deleted = 0;
+
+	return 1;
+}
+
+/**
+ * Return a bit mask with bit i set if byte i of the group is byte.
+ */
+static uint32_t matchByte( const unsigned char* group, unsigned char byte )
+{
+#ifdef __SSE2__
+	__m128i bytes = _mm_loadu_si128( (const __m128i*)group );
+	return (uint32_t)_mm_movemask_epi8( _mm_cmpeq_epi8( bytes, _mm_set1_epi8( (char)byte ) ) );
+#else
+	uint32_t mask = 0;
+	int i;
+
+	for( i = 0; i < HT_GROUP_SIZE; i++ )
+	{
+		mask |= (uint32_t)( group[i] == byte ) << i;
+	}
+
+	return mask;
+#endif
+}
+
+/**
+ * Return a bit mask with bit i set if slot i of the group is empty or
+ * deleted, which are the control bytes with the high bit set.
+ */
+static uint32_t matchFree( const unsigned char* group )
+{
+#ifdef __SSE2__
+	return (uint32_t)_mm_movemask_epi8( _mm_loadu_si128( (const __m128i*)group ) );
+#else
+	uint32_t mask = 0;
+	int i;
+
+	for( i = 0; i < HT_GROUP_SIZE; i++ )
+	{
+		mask |= (uint32_t)( group[i] >> 7 ) << i;
+	}
+
+	return mask;
+#endif
+}
+
+/**
+ * Probe for key, group by group, starting at its home slot.  Each step moves
+ * one group further than the last, which visits every group of a power-of-two
+ * table.  An empty slot in a group ends the search, since the key would have
+ * been put there.
+ *
+ * Return the key's slot, or NOT_FOUND.
+ */
+static size_t findSlot( HashTablePtr table, uint64_t hash, const char* key, size_t length )
+{
+	size_t mask = table->capacity - 1;
+	size_t position = HASH_HOME( hash ) & mask;
+	size_t step = 0;
+	unsigned char tag = HASH_TAG( hash );
+
+	while( 1 )
+	{
+		const unsigned char* group = table->control + position;
+		uint32_t matches = matchByte( group, tag );
+
+		while( matches != 0 )
+		{
+			size_t slot = ( position + __builtin_ctz( matches ) ) & mask;
+			HashSlotPtr s = &table->slots[slot];
+
+			if( s->hash == hash && s->length == length && memcmp( s->key, key, length ) == 0 )
+			{
+				return slot;
+			}
+
+			matches &= matches - 1;
+		}
+
+		if( matchByte( group, HT_EMPTY ) != 0 )
+		{
+			return NOT_FOUND;
+		}
+
+		step += HT_GROUP_SIZE;
+		position = ( position + step ) & mask;
+	}
+}
+
+/**
+ * Return the first empty or deleted slot on hash's probe sequence.  The
+ * table is never full, so there always is one.
+ */
+static size_t freeSlot( HashTablePtr table, uint64_t hash )
+{
+	size_t mask = table->capacity - 1;
+	size_t position = HASH_HOME( hash ) & mask;
+	size_t step = 0;
+
+	while( 1 )
+	{
+		uint32_t matches = matchFree( table->control + position );
+
+		if( matches != 0 )
+		{
+			return ( position + __builtin_ctz( matches ) ) & mask;
+		}
+
+		step += HT_GROUP_SIZE;
+		position = ( position + step ) & mask;
+	}
+}
+
+/**
+ * Move every key into a fresh set of capacity slots, dropping deleted slots.
+ * The stored hashes are reused, so no key is hashed or compared.
+ *
+ * Return 1 if successful, 0 otherwise, in which case table is unchanged.
+ */
+static int rehash( HashTablePtr table, size_t capacity )
+{
+	struct HashTable old = *table;
+	size_t i;
+
+	if( !allocate( table, capacity ) )
+	{
+		return 0;
+	}
+
+	for( i = 0; i < old.capacity; i++ )
+	{
+		if( !( old.control[i] & 0x80 ) )
+		{
+			size_t slot = freeSlot( table, old.slots[i].hash );
+			setControl( table, slot, old.control[i] );
+			table->slots[slot] = old.slots[i];
+		}
+	}
+
+	table->count = old.count;
+
+	free( old.control );
+	free( old.slots );
+
+	return 1;
+}
+
+/**
+ * Set the control byte of slot, and of its copy if it is in the first group.
+ */
+static void setControl( HashTablePtr table, size_t slot, unsigned char byte )
+{
+	table->control[slot] = byte;
+
+	if( slot < HT_GROUP_SIZE )
+	{
+		table->control[table->capacity + slot] = byte;
+	}
+}
+
+HashTablePtr HTCreate()
+{
+	HashTablePtr table = malloc( sizeof(*table) );
+
+	if( table == NULL )
+	{
+		return NULL;
+	}
+
+	if( !allocate( table, HT_MIN_CAPACITY ) )
+	{
+		free( table );
+		return NULL;
+	}
+
+	return table;
+}
+
+void** HTFind( HashTablePtr table, uint64_t hash, const char* key, size_t length )
+{
+	size_t slot = findSlot( table, hash, key, length );
+
+	return slot == NOT_FOUND ? NULL : &table->slots[slot].value;
+}
+
+void** HTPut( HashTablePtr table, uint64_t hash, const char* key, size_t length )
+{
+	size_t slot = findSlot( table, hash, key, length );
+
+	if( slot != NOT_FOUND )
+	{
+		return &table->slots[slot].value;
+	}
+
+	/*
+	 * Keep at least one slot in eight empty, so that probes stay short.  If
+	 * the table is mostly deleted slots, clearing them out is enough;
+	 * otherwise it doubles.
+	 */
+	if( ( table->count + table->deleted + 1 ) * 8 > table->capacity * 7 )
+	{
+		size_t capacity = ( table->count + 1 ) * 16 > table->capacity * 7 ? table->capacity * 2 : table->capacity;
+
+		if( !rehash( table, capacity ) )
+		{
+			return NULL;
+		}
+	}
+
+	slot = freeSlot( table, hash );
+
+	if( table->control[slot] == HT_DELETED )
+	{
+		table->deleted--;
+	}
+
+	setControl( table, slot, HASH_TAG( hash ) );
+	table->count++;
+
+	HashSlotPtr s = &table->slots[slot];
+	s->hash = hash;
+	s->key = key;
+	s->length = length;
+	s->value = NULL;
+
+	return &s->value;
+}
+
+int HTRemove( HashTablePtr table, uint64_t hash, const char* key, size_t length )
+{
+	size_t slot = findSlot( table, hash, key, length );
+
+	if( slot == NOT_FOUND )
+	{
+		return 0;
+	}
+
+	/* The slot may be in the middle of another key's probe sequence, so it cannot simply be made empty. */
+	setControl( table, slot, HT_DELETED );
+	table->count--;
+	table->deleted++;
+
+	return 1;
+}
+
+HashSlotPtr HTNext( HashTablePtr table, size_t* position )
+{
+	while( *position < table->capacity )
+	{
+		size_t slot = (*position)++;
+
+		if( !( table->control[slot] & 0x80 ) )
+		{
+			return &table->slots[slot];
+		}
+	}
+
+	return NULL;
+}
+
+void HTClear( HashTablePtr table )
+{
+	memset( table->control, HT_EMPTY, table->capacity + HT_GROUP_SIZE );
+	table->count = 0;
+	table->deleted = 0;
+}
+
+void HTDestroy( HashTablePtr table )
+{
+	if( table == NULL )
+	{
+		return;
+	}
+
+	free( table->control );
+	free( table->slots );
+	free( table );
+}
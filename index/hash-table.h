@@ -0,0 +1,104 @@
+#ifndef index_hash_table_h
+#define index_hash_table_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * hash-table.h
+ *
+ * An open-addressing hash table in the style of a Swiss table, mapping byte
+ * strings to pointers.  Beside the slots is an array of one control byte per
+ * slot: empty, deleted, or the low 7 bits of the hash of the slot's key.  A
+ * lookup compares a group of 16 control bytes at once against those 7 bits,
+ * so most misses never touch a slot, and only slots whose bits match have
+ * their full hash and then their key compared.
+ *
+ * Every slot keeps its key's 64-bit hash, which the caller computes (see
+ * hash.h) and which is never recomputed, not even to grow the table.  Keys
+ * are not copied: each must stay valid for as long as it is in the table.
+ */
+
+/* The number of control bytes probed at once. */
+#define HT_GROUP_SIZE 16
+
+/* The smallest capacity; a table always holds at least one group. */
+#define HT_MIN_CAPACITY 16
+
+/* Control bytes for a slot that has never been used and for a removed slot. */
+#define HT_EMPTY 0x80
+#define HT_DELETED 0xFE
+
+struct HashSlot
+{
+	uint64_t hash;
+	const char* key;
+	size_t length;
+	void* value;
+};
+typedef struct HashSlot* HashSlotPtr;
+
+struct HashTable
+{
+	/* capacity control bytes, followed by a copy of the first group so that a group can be read at any slot. */
+	unsigned char* control;
+	HashSlotPtr slots;
+
+	/* A power of two. */
+	size_t capacity;
+
+	/* The number of keys, and the number of deleted slots not yet reused. */
+	size_t count;
+	size_t deleted;
+};
+typedef struct HashTable* HashTablePtr;
+
+/*
+ * HTCreate creates a new, empty table.
+ *
+ * If the function succeeds, it returns a non-NULL HashTablePtr.
+ * Else it returns NULL.
+ */
+HashTablePtr HTCreate();
+
+/*
+ * HTFind looks up the length bytes at key, whose hash is hash.
+ *
+ * Returns a pointer to the key's value, or NULL if the key is not in the table.
+ */
+void** HTFind( HashTablePtr table, uint64_t hash, const char* key, size_t length );
+
+/*
+ * HTPut looks up the length bytes at key, whose hash is hash, adding the key
+ * with a NULL value if it is not in the table yet.
+ *
+ * Returns a pointer to the key's value, or NULL if the key had to be added
+ * and no memory could be allocated.
+ */
+void** HTPut( HashTablePtr table, uint64_t hash, const char* key, size_t length );
+
+/*
+ * HTRemove removes the length bytes at key, whose hash is hash, from the table.
+ *
+ * Returns 1 if the key was in the table, 0 otherwise.
+ */
+int HTRemove( HashTablePtr table, uint64_t hash, const char* key, size_t length );
+
+/*
+ * HTNext returns the first slot in use at or after *position, and moves
+ * *position past it; start with *position at 0.  Returns NULL once every
+ * slot has been visited.  The table must not be changed during the walk.
+ */
+HashSlotPtr HTNext( HashTablePtr table, size_t* position );
+
+/*
+ * HTClear removes every key, keeping the table's memory for reuse.
+ */
+void HTClear( HashTablePtr table );
+
+/*
+ * HTDestroy destroys the table.  The keys and values are not freed.
+ */
+void HTDestroy( HashTablePtr table );
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef index_hash_h
+#define index_hash_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * hash.h
+ *
+ * A fast 64-bit hash of a byte string, in the style of wyhash: eight bytes at
+ * a time are folded in with a 64x64->128-bit multiply.  It is not meant to
+ * resist deliberate collisions, only to spread terms evenly over a table.
+ */
+
+#define HASH_SEED 0xa0761d6478bd642fULL
+#define HASH_MULTIPLIER 0xe7037ed1a0b428dbULL
+
+/*
+ * Multiply a by b into 128 bits and fold the halves together.
+ */
+static inline uint64_t HashMix( uint64_t a, uint64_t b )
+{
+	__uint128_t product = (__uint128_t)a * b;
+
+	return (uint64_t)product ^ (uint64_t)( product >> 64 );
+}
+
+/*
+ * HashTail returns the final 1 to 8 bytes of a key, the length bytes at key,
+ * as one word, in memory order with the unused bytes zero.  A scan that has
+ * already loaded those bytes in a wider word can mask them out of it
+ * instead (see HashTailMask).
+ */
+static inline uint64_t HashTail( const char* key, size_t length )
+{
+	uint64_t word = 0;
+
+	memcpy( &word, key, length );
+
+	return word;
+}
+
+/*
+ * HashTailMask returns the mask that keeps the first length bytes, 1 to 8,
+ * of a word loaded from memory, so that masking gives what HashTail would.
+ */
+static inline uint64_t HashTailMask( size_t length )
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return ~0ULL << ( 64 - 8 * length );
+#else
+	return ~0ULL >> ( 64 - 8 * length );
+#endif
+}
+
+/*
+ * HashFinish returns the hash of a key of length bytes from h, the state
+ * after its leading words, and tail, its HashTail.  The length only comes in
+ * here, so a key can be hashed as it is scanned, before its end is known.
+ */
+static inline uint64_t HashFinish( uint64_t h, uint64_t tail, size_t length )
+{
+	return HashMix( HashMix( h ^ tail, HASH_MULTIPLIER ) ^ HASH_SEED, HASH_MULTIPLIER ^ length );
+}
+
+/*
+ * HashBytes returns the hash of the length bytes at key.  Starting from
+ * HASH_SEED, every 8 bytes but the last 1 to 8 are folded in with HashMix
+ * and HASH_MULTIPLIER, and the rest with HashTail and HashFinish.
+ */
+static inline uint64_t HashBytes( const char* key, size_t length )
+{
+	uint64_t h = HASH_SEED;
+	size_t remaining = length;
+	uint64_t word;
+
+	while( remaining > 8 )
+	{
+		memcpy( &word, key, 8 );
+		h = HashMix( h ^ word, HASH_MULTIPLIER );
+		key += 8;
+		remaining -= 8;
+	}
+
+	return HashFinish( h, HashTail( key, remaining ), length );
+}
+
+#endif
@@ -1,436 +1,2186 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include "index.h"
+#include "binary-index.h"
+#include "file-map.h"
+#include "hash.h"
+#include "manifest.h"
+#include "query.h"
+#include "run-file.h"
+#include "scheduler.h"
+#include "string-sort.h"
 #include "tokenizer.h"
 
-int addFile(SortedListPtr files, char* file_path, TermPtr t );
-int addTerm( char* new_term, char* file_path );
-void cleanup();
-TermPtr createTermPtr();
-FilePtr createFilePtr();
-void deleteTerm( char* target_term );
-int fileCompare( void*, void* );
+int addFileTerms( IndexPtr index, uint32_t file_id, TermCountsPtr counts );
+TermPtr addTerm( IndexPtr index, uint64_t hash, char* new_term, size_t term_length );
+int appendFile( FileListPtr files, char* file_path, size_t file_size, int64_t mtime );
+int buildIndex( IndexPtr index, FileListPtr files, uint32_t* ids, size_t id_count, int jobs );
+int collectInput( char* file_path, FileListPtr files );
+void collectKey( void* keys, uint64_t hash, const char* key, size_t length, void* value );
+int countTokens( TermCountsPtr counts, TokenizerT* tk );
+FileListPtr createFileList();
+IndexPtr createIndex();
+TermPtr createTermPtr( ArenaPtr arena );
+void destroyFileList( FileListPtr files );
+void destroyIndex( IndexPtr index );
+void excludeFile( char* file_path, char* suffix );
 int filePathCompare( char*, char* );
-TermPtr findTerm( char* target_term );
-char *getFileContents(char* file_path );
-int insertFileIntoList( SortedListPtr files, char* file_path );
-int keyCompare( void*, void* );
-void parseFileContents( char* file_path, char* file_contents );
-void processInput( char* file_path );
-void writeFile( char* file_path );
+size_t findFile( FileListPtr files, const char* file_path );
+TermPtr findTerm( IndexPtr index, uint64_t hash, char* target_term, size_t term_length );
+int hashFile( char* file_path, uint64_t* hash );
+size_t indexBytes( IndexPtr index );
+void indexFileTask( void* build, int worker, size_t file );
+int isExcluded( struct stat* info );
+void mergeIndex( IndexPtr dest, IndexPtr src );
+void mergeTerm( void* dest, uint64_t hash, const char* key, size_t length, void* value );
+struct SSItem* orderedKeys( IndexPtr index, int threads );
+int parseFileContents( IndexPtr index, uint32_t file_id, char* file_contents, size_t file_length, TKEscapeMode escapes, size_t* tokens );
+int parseOptions( int argc, char** argv );
+void printUsage();
+int sizedPathCompare( const void*, const void* );
+int processFile( IndexPtr index, FileListPtr files, uint32_t file_id );
+int processLargeFile( IndexPtr index, FileListPtr files, uint32_t file_id, int ranges );
+void processInput( IndexPtr index, char* file_path, char* index_path );
+void removeRuns();
+void resetIndex( IndexPtr index );
+int reuseIndex( IndexPtr index, QueryIndexPtr old, unsigned char* kept );
+void* runRangeTask( void* task );
+int sortFileList( FileListPtr files );
+int spillIfFull( IndexPtr index, int threads );
+int spillIndex( IndexPtr index, int threads );
+size_t updateIndex( IndexPtr index, char* index_path, uint32_t* ids );
+int writeBinaryTerm( void* writer, FILE* file, char* term, size_t term_length, PostingPtr postings, size_t count );
+void writeFile( IndexPtr index, char* file_path );
+void writeList( FILE* file, FileListPtr files, char* term, PostingPtr postings, size_t count );
+void writeManifest( FileListPtr files, char* index_path );
+int writeTextTerm( void* files, FILE* file, char* term, size_t term_length, PostingPtr postings, size_t count );
+
+/* 1 if the index is written in the binary format of binary-index.h, 0 for text. */
+int binary_format = 0;
+
+/* The backend of every index's term dictionary; see DictBackend. */
+DictBackend dictionary_backend = DICT_DEFAULT_BACKEND;
+
+/* How backslash escape sequences in the input are treated; see TKEscapeMode. */
+TKEscapeMode escape_mode = TK_ESCAPES_AUTO;
 
-SortedListPtr keys;
-TermPtr values;
+/*
+ * 1 if an existing index is brought up to date rather than refused: only the
+ * files that changed since it was written, by its manifest, are read again.
+ */
+int incremental = 0;
+
+/* The number of threads used to build the index. */
+int jobs = 1;
+
+/*
+ * The most memory, in bytes, that the terms and postings held in memory may
+ * take before they are spilled to disk as a sorted run; 0 for no limit.  In a
+ * parallel build, each thread gets an even share.
+ */
+size_t mem_limit = 0;
+
+/* 1 if per-worker scheduling statistics should be printed after a parallel build. */
+int print_stats = 0;
+
+/*
+ * In a parallel build, files of at least this many bytes are split into byte
+ * ranges that are tokenized on all threads at once.  0 disables splitting.
+ */
+size_t split_size = 64 * 1024 * 1024;
+
+/* The directory in which runs are spilled; NULL for $TMPDIR, or /tmp. */
+char* temp_dir = NULL;
+
+/*
+ * The sorted runs spilled so far, shared by every thread of a build.  They
+ * are kept in a private directory, created by the first spill.
+ */
+struct Runs
+{
+	pthread_mutex_t lock;
+	char* directory;
+	char** paths;
+	size_t count;
+	size_t capacity;
+
+	/* The number of runs started, each of which is numbered. */
+	size_t started;
+};
+
+struct Runs runs = { PTHREAD_MUTEX_INITIALIZER, NULL, NULL, 0, 0, 0 };
+
+/* The most files excludeFile can keep out of the input. */
+#define MAX_EXCLUDED 4
+
+/*
+ * Files that are never indexed, by device and inode: with --incremental, the
+ * index itself, its manifest and their temporary files, which may lie in the
+ * tree being indexed.
+ */
+struct ExcludedFile
+{
+	dev_t device;
+	ino_t inode;
+};
+
+struct ExcludedFile excluded[MAX_EXCLUDED];
+size_t excluded_count = 0;
+
+
+/*
+ * State shared by the workers of a parallel build.  Each worker indexes into
+ * its own private index, so no locking is needed while tokenizing.
+ */
+struct Build
+{
+	/* The files to index. */
+	FileListPtr files;
+
+	/* The IDs of the files handed to the scheduler, by scheduler item. */
+	uint32_t* ids;
+
+	/* One private index per worker; merged into the final index once all files are done. */
+	IndexPtr* indexes;
+
+	/* Set for each worker that failed to index one of its files. */
+	int* failed;
+};
+
+/*
+ * One byte range of a large file, tokenized on its own thread into its own index.
+ */
+struct RangeTask
+{
+	pthread_t thread;
+
+	/* The range's tokens, counted. */
+	TermCountsPtr counts;
+
+	/* The range's text, which starts and ends on a token boundary. */
+	char* start;
+	size_t length;
+
+	/* Whether every token of the range was counted. */
+	int successful;
+};
+
+/*
+ * The keys of an index and their terms, gathered by collectKey to be written.
+ */
+struct KeyList
+{
+	struct SSItem* keys;
+	size_t count;
+};
+
+/**
+ * Merge one file's counted tokens into index.  Every term in counts gets a
+ * single new posting for file_id, holding the term's count.  The file cannot
+ * already be in any term's postings, so it is appended without searching
+ * them; postings are put in order when the index is written.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+int addFileTerms( IndexPtr index, uint32_t file_id, TermCountsPtr counts )
+{
+	size_t position = 0;
+	HashSlotPtr slot;
+
+	/* The hash of each term was computed by the tokenizer, and is reused here. */
+	while( ( slot = HTNext( counts->table, &position ) ) != NULL )
+	{
+		TermCountPtr entry = slot->value;
+		TermPtr t = findTerm( index, slot->hash, entry->term, entry->term_length );
+
+		if( t == NULL )
+		{
+			t = addTerm( index, slot->hash, entry->term, entry->term_length );
+
+			if( t == NULL )
+			{
+				return 0;
+			}
+		}
+
+		if( !PLAppend( &t->files, index->arena, file_id, entry->count ) )
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Create a TermPtr with no postings and add it to the index's values
+ * dictionary.  new_term is a view of term_length bytes, whose hash is hash,
+ * that need not be null-terminated; the term is copied here, as this is the
+ * only point at which the index takes ownership of it.  Most terms are short
+ * enough to be copied into the Term itself, so that the dictionary's key is
+ * on the same cache line as the postings it leads to.
+ *
+ * Return the new TermPtr if successfully added, NULL otherwise.
+ */
+TermPtr addTerm( IndexPtr index, uint64_t hash, char* new_term, size_t term_length )
+{
+	if( term_length > UINT32_MAX )
+	{
+		return NULL;
+	}
+
+	/* Initialize TermPtr containing the new term and its (empty) postings. */
+	TermPtr t = createTermPtr( index->arena );
+
+	if( t == NULL )
+	{
+		return NULL;
+	}
+
+	t->term_length = term_length;
+	if( term_length < TERM_INLINE_SIZE )
+	{
+		t->term = t->inline_term;
+	}
+	else
+	{
+		t->term = ArenaAlloc( index->arena, term_length + 1 );
+
+		if( t->term == NULL )
+		{
+			return NULL;
+		}
+	}
+	memcpy( t->term, new_term, term_length );
+	t->term[term_length] = '\0';
+
+	void** value = DictPut( index->values, hash, t->term, t->term_length );
+
+	if( value == NULL )
+	{
+		return NULL;
+	}
+	*value = t;
+
+	return t;
+}
+
+/**
+ * Append a copy of file_path, whose size is file_size bytes and whose
+ * modification time is mtime, to the given list of files.
+ *
+ * Return 1 if successful; 0 otherwise.
+ */
+int appendFile( FileListPtr files, char* file_path, size_t file_size, int64_t mtime )
+{
+	/* A file's position in the list becomes its ID, which must fit in 32 bits. */
+	if( files->count > UINT32_MAX )
+	{
+		return 0;
+	}
+
+	if( files->count == files->capacity )
+	{
+		size_t capacity = files->capacity > 0 ? files->capacity * 2 : 64;
+		char** paths = realloc( files->paths, capacity * sizeof(*paths) );
+
+		if( paths == NULL )
+		{
+			return 0;
+		}
+		files->paths = paths;
+
+		size_t* sizes = realloc( files->sizes, capacity * sizeof(*sizes) );
+
+		if( sizes == NULL )
+		{
+			return 0;
+		}
+		files->sizes = sizes;
+
+		int64_t* mtimes = realloc( files->mtimes, capacity * sizeof(*mtimes) );
+
+		if( mtimes == NULL )
+		{
+			return 0;
+		}
+		files->mtimes = mtimes;
+
+		files->capacity = capacity;
+	}
+
+	char* copy = strdup( file_path );
+
+	if( copy == NULL )
+	{
+		return 0;
+	}
+
+	files->paths[files->count] = copy;
+	files->sizes[files->count] = file_size;
+	files->mtimes[files->count] = mtime;
+	files->count++;
+
+	return 1;
+}
+
+/**
+ * Index the id_count files in the given list whose IDs are in ids into
+ * index.  With more than one job, the
+ * files are spread over that many threads by a work-stealing scheduler that
+ * balances them by size, each thread building a private index that is merged
+ * into index once every file has been read.  Files of split_size bytes or more
+ * are done first, one at a time, each split across all of the threads.
+ *
+ * Return 1 if successful, 0 if some file could not be indexed.
+ */
+int buildIndex( IndexPtr index, FileListPtr files, uint32_t* ids, size_t id_count, int jobs )
+{
+	size_t i;
+	int w;
+	int successful = 1;
+
+	index->budget = mem_limit;
+
+	if( jobs <= 1 )
+	{
+		for( i = 0; successful && i < id_count; i++ )
+		{
+			successful = processFile( index, files, ids[i] );
+			spillIfFull( index, 1 );
+		}
+		return successful;
+	}
+
+	/* The IDs and sizes of the files that are not split, in the same order. */
+	uint32_t* rest_ids = malloc( ( id_count > 0 ? id_count : 1 ) * sizeof(*rest_ids) );
+	size_t* rest_sizes = malloc( ( id_count > 0 ? id_count : 1 ) * sizeof(*rest_sizes) );
+	size_t rest_count = 0;
+
+	/* Without room to plan a parallel build, the files are indexed one by one on this thread. */
+	if( rest_ids == NULL || rest_sizes == NULL )
+	{
+		free( rest_ids );
+		free( rest_sizes );
+		return buildIndex( index, files, ids, id_count, 1 );
+	}
+
+	for( i = 0; i < id_count; i++ )
+	{
+		if( split_size > 0 && files->sizes[ids[i]] >= split_size )
+		{
+			if( !processLargeFile( index, files, ids[i], jobs ) )
+			{
+				free( rest_ids );
+				free( rest_sizes );
+				return 0;
+			}
+			spillIfFull( index, jobs );
+		}
+		else
+		{
+			rest_ids[rest_count] = ids[i];
+			rest_sizes[rest_count] = files->sizes[ids[i]];
+			rest_count++;
+		}
+	}
+
+	SchedulerPtr scheduler = NULL;
+
+	if( rest_count > 1 )
+	{
+		scheduler = SchedCreate( rest_sizes, rest_count, jobs );
+	}
+
+	if( scheduler == NULL )
+	{
+		for( i = 0; successful && i < rest_count; i++ )
+		{
+			successful = processFile( index, files, rest_ids[i] );
+			spillIfFull( index, jobs );
+		}
+
+		free( rest_ids );
+		free( rest_sizes );
+		return successful;
+	}
+
+	struct Build build;
+	build.files = files;
+	build.ids = rest_ids;
+	build.indexes = calloc( jobs, sizeof(*build.indexes) );
+	build.failed = calloc( jobs, sizeof(*build.failed) );
+
+	int ready = build.indexes != NULL && build.failed != NULL;
+
+	for( w = 0; ready && w < jobs; w++ )
+	{
+		build.indexes[w] = createIndex();
+		ready = build.indexes[w] != NULL;
+
+		if( ready )
+		{
+			build.indexes[w]->budget = mem_limit / jobs;
+		}
+	}
+
+	/* If the workers' indexes could not be made, or no thread could be started, fall back to indexing on this one. */
+	if( !ready || SchedRun( scheduler, indexFileTask, &build ) == 0 )
+	{
+		for( i = 0; successful && i < rest_count; i++ )
+		{
+			successful = processFile( index, files, rest_ids[i] );
+			spillIfFull( index, jobs );
+		}
+	}
+
+	for( w = 0; ready && w < jobs; w++ )
+	{
+		if( build.failed[w] )
+		{
+			successful = 0;
+		}
+	}
+
+	for( w = 0; successful && build.indexes != NULL && w < jobs; w++ )
+	{
+		if( build.indexes[w] != NULL )
+		{
+			mergeIndex( index, build.indexes[w] );
+			spillIfFull( index, jobs );
+		}
+	}
+
+	if( print_stats )
+	{
+		SchedPrintStats( scheduler, stderr );
+		if( runs.count > 0 )
+		{
+			fprintf( stderr, "spilled %zu runs\n", runs.count );
+		}
+	}
+
+	for( w = 0; !successful && build.indexes != NULL && w < jobs; w++ )
+	{
+		if( build.indexes[w] != NULL )
+		{
+			destroyIndex( build.indexes[w] );
+		}
+	}
+
+	free( build.indexes );
+	free( build.failed );
+	free( rest_ids );
+	free( rest_sizes );
+	SchedDestroy( scheduler );
+
+	return successful;
+}
+
+/**
+ * Parse the file_path to discover whether or not it is a directory.
+ * If the given path is a directory, recursively collect its contents.
+ * If the given path is anything else, append it to files.  A path that
+ * cannot be read is skipped.
+ *
+ * Return 1 if successful, 0 if some file could not be added to files.
+ */
+int collectInput( char* file_path, FileListPtr files )
+{
+	struct stat info;
+
+	if( lstat( file_path, &info ) != 0 )
+	{
+		return 1;
+	}
+
+	/* Symbolic links to directories are not followed, so the walk cannot loop. */
+	if( S_ISLNK( info.st_mode ) )
+	{
+		if( stat( file_path, &info ) != 0 || S_ISDIR( info.st_mode ) )
+		{
+			return 1;
+		}
+	}
+
+	if( isExcluded( &info ) )
+	{
+		return 1;
+	}
+
+	if( !S_ISDIR( info.st_mode ) )
+	{
+		if( S_ISREG( info.st_mode ) )
+		{
+			return appendFile( files, file_path, info.st_size, (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec );
+		}
+
+		return appendFile( files, file_path, 0, 0 );
+	}
+
+	DIR* dir = opendir( file_path );
+
+	/* Only a directory that cannot be read is skipped, not one there was no memory to open. */
+	if( dir == NULL )
+	{
+		return errno != ENOMEM;
+	}
+
+	size_t path_length = strlen( file_path );
+	struct dirent* entry = readdir( dir );
+	int successful = 1;
+
+	while( successful && entry != NULL )
+	{
+		if( strcmp( entry->d_name, "." ) != 0 && strcmp( entry->d_name, ".." ) != 0 )
+		{
+			/* Entry names are relative to the directory, so prefix them with its path. */
+			size_t name_length = strlen( entry->d_name );
+			char* child = malloc( path_length + name_length + 2 );
+
+			if( child == NULL )
+			{
+				successful = 0;
+				break;
+			}
+
+			memcpy( child, file_path, path_length );
+			if( path_length > 0 && file_path[path_length - 1] == '/' )
+			{
+				memcpy( child + path_length, entry->d_name, name_length + 1 );
+			}
+			else
+			{
+				child[path_length] = '/';
+				memcpy( child + path_length + 1, entry->d_name, name_length + 1 );
+			}
+
+			successful = collectInput( child, files );
+			free( child );
+		}
+
+		entry = readdir( dir );
+	}
+
+	closedir( dir );
+
+	return successful;
+}
+
+/**
+ * Dictionary visitor for writeFile: append the term value, under its text, to
+ * the KeyList keys.
+ */
+void collectKey( void* keys, uint64_t hash, const char* key, size_t length, void* value )
+{
+	struct KeyList* list = keys;
+	struct SSItem* item = &list->keys[list->count++];
+
+	item->string = ((TermPtr)value)->term;
+	item->value = value;
+}
+
+/**
+ * Count every token that tk yields in counts.  The entries of counts refer
+ * into the tokenizer's text, so they must be used before tk is destroyed.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+int countTokens( TermCountsPtr counts, TokenizerT* tk )
+{
+	size_t token_length = 0;
+	uint64_t hash = 0;
+	char* token = TKGetNextTokenHashed( tk, &token_length, &hash );
+
+	while( token != NULL )
+	{
+		if( !TCAdd( counts, hash, token, token_length, 1 ) )
+		{
+			return 0;
+		}
+
+		token = TKGetNextTokenHashed( tk, &token_length, &hash );
+	}
+
+	return 1;
+}
+
+FileListPtr createFileList()
+{
+	FileListPtr files = malloc(sizeof(*files));
+
+	if( files == NULL )
+	{
+		return NULL;
+	}
+
+	files->paths = NULL;
+	files->sizes = NULL;
+	files->mtimes = NULL;
+	files->lengths = NULL;
+	files->hashes = NULL;
+	files->count = 0;
+	files->capacity = 0;
+
+	return files;
+}
+
+IndexPtr createIndex()
+{
+	IndexPtr index = malloc(sizeof(*index));
+
+	if( index == NULL )
+	{
+		return NULL;
+	}
+
+	index->values = DictCreate( dictionary_backend );
+	index->file_terms = TCCreate();
+	index->arena = ArenaCreate();
+	index->files = NULL;
+	index->budget = 0;
+
+	if( index->values == NULL || index->file_terms == NULL || index->arena == NULL )
+	{
+		destroyIndex( index );
+		return NULL;
+	}
+
+	return index;
+}
+
+TermPtr createTermPtr( ArenaPtr arena )
+{
+	TermPtr t = ArenaAllocAligned( arena, sizeof(*t), TERM_ALIGNMENT );
+
+	if( t == NULL )
+	{
+		return NULL;
+	}
+
+	t->term = NULL;
+	t->term_length = 0;
+	PLInit( &t->files );
+
+	return t;
+}
+
+void destroyFileList( FileListPtr files )
+{
+	size_t i;
+
+	for( i = 0; i < files->count; i++ )
+	{
+		free( files->paths[i] );
+	}
+
+	free( files->paths );
+	free( files->sizes );
+	free( files->mtimes );
+	free( files->lengths );
+	free( files->hashes );
+	free( files );
+}
+
+/**
+ * Destroy the given index along with every term and file it holds.  All of
+ * them live in the index's arena, so they are freed along with it rather
+ * than one by one.
+ */
+void destroyIndex( IndexPtr index )
+{
+	DictDestroy( index->values );
+	ArenaDestroy( index->arena );
+	TCDestroy( index->file_terms );
+	if( index->files != NULL )
+	{
+		destroyFileList( index->files );
+	}
+	free( index );
+}
+
+/**
+ * Keep the file at file_path with suffix appended, if it exists, out of the
+ * input, however it is reached.
+ */
+void excludeFile( char* file_path, char* suffix )
+{
+	struct stat info;
+	char* path = malloc( strlen( file_path ) + strlen( suffix ) + 1 );
+
+	if( path == NULL )
+	{
+		printf("ERROR: out of memory\n");
+		exit( EXIT_FAILURE );
+	}
+
+	sprintf( path, "%s%s", file_path, suffix );
+
+	if( stat( path, &info ) == 0 && excluded_count < MAX_EXCLUDED )
+	{
+		excluded[excluded_count].device = info.st_dev;
+		excluded[excluded_count].inode = info.st_ino;
+		excluded_count++;
+	}
+
+	free( path );
+}
+
+int filePathCompare( char* a, char* b )
+{
+	return strcmp( a, b );
+}
+
+/**
+ * Look up file_path in the sorted list files.
+ *
+ * Return the file's ID if it is in the list, files->count otherwise.
+ */
+size_t findFile( FileListPtr files, const char* file_path )
+{
+	size_t low = 0;
+	size_t high = files->count;
+
+	while( low < high )
+	{
+		size_t middle = low + ( high - low ) / 2;
+		int comparison = filePathCompare( files->paths[middle], (char*)file_path );
+
+		if( comparison == 0 )
+		{
+			return middle;
+		}
+
+		if( comparison < 0 )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return files->count;
+}
+
+/**
+ * Look up the term whose text is the length bytes at target, and whose hash
+ * is hash.  target need not be null-terminated.
+ *
+ * Return the TermPtr if it exists, NULL otherwise.
+ */
+TermPtr findTerm( IndexPtr index, uint64_t hash, char* target, size_t length )
+{
+	void** value = DictFind( index->values, hash, target, length );
+
+	return value != NULL ? *value : NULL;
+}
+
+/**
+ * Hash the contents of the file at file_path into *hash, as the manifest
+ * records them.
+ *
+ * Return 1 if the file was read, 0 otherwise.
+ */
+int hashFile( char* file_path, uint64_t* hash )
+{
+	FileContentsPtr contents = FMOpen( file_path );
+
+	if( contents == NULL )
+	{
+		return 0;
+	}
+
+	*hash = HashBytes( contents->data, contents->length );
+	FMClose( contents );
+
+	return 1;
+}
+
+/**
+ * Return roughly how much memory index takes for its terms and postings.
+ */
+size_t indexBytes( IndexPtr index )
+{
+	return index->arena->bytes + DictBytes( index->values );
+}
+
+/**
+ * Scheduler task for a parallel build: index the given file into the
+ * calling worker's private index.
+ */
+void indexFileTask( void* build, int worker, size_t file )
+{
+	struct Build* self = build;
+
+	/* Once a worker has failed the build will be abandoned, so its remaining files are not read. */
+	if( self->failed[worker] || !processFile( self->indexes[worker], self->files, self->ids[file] ) )
+	{
+		self->failed[worker] = 1;
+		return;
+	}
+
+	/* Every worker spills its own index, sorting it on its own thread, while the others carry on. */
+	spillIfFull( self->indexes[worker], 1 );
+}
+
+/**
+ * Return 1 if the file described by info was kept out of the input by
+ * excludeFile, 0 otherwise.
+ */
+int isExcluded( struct stat* info )
+{
+	size_t i;
+
+	for( i = 0; i < excluded_count; i++ )
+	{
+		if( excluded[i].device == info->st_dev && excluded[i].inode == info->st_ino )
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Move every term and posting of src into dest, then destroy src.  The two
+ * indexes must have been built from disjoint sets of files, so each posting is
+ * simply appended to the matching term's postings rather than being combined
+ * with an existing entry.
+ */
+void mergeIndex( IndexPtr dest, IndexPtr src )
+{
+	/* src's terms and postings stay where they are, so dest takes over its memory. */
+	ArenaMerge( dest->arena, src->arena );
+
+	DictWalk( src->values, mergeTerm, dest );
+
+	DictDestroy( src->values );
+	TCDestroy( src->file_terms );
+	free( src );
+}
+
+/**
+ * Dictionary visitor for mergeIndex: move the term value, from the index
+ * being merged, into the index dest.
+ */
+void mergeTerm( void* dest, uint64_t hash, const char* key, size_t length, void* value )
+{
+	IndexPtr index = dest;
+	TermPtr t = value;
+	TermPtr existing = findTerm( index, hash, t->term, t->term_length );
+
+	/* A term new to dest is adopted whole. */
+	if( existing == NULL )
+	{
+		void** slot = DictPut( index->values, hash, t->term, t->term_length );
+
+		if( slot != NULL )
+		{
+			*slot = t;
+		}
+		return;
+	}
+
+	PLAppendAll( &existing->files, &t->files );
+}
+
+/**
+ * Return the keys of index, each with its TermPtr as value, in descending
+ * order, in a new array of DictCount( index->values ) items (never NULL unless
+ * out of memory), which the caller frees.  A dictionary that keeps its keys in order hands them
+ * over ascending, so they only need reversing; otherwise they are put in
+ * order here, with a radix sort over all of them at once on threads threads.
+ */
+struct SSItem* orderedKeys( IndexPtr index, int threads )
+{
+	size_t key_count = DictCount( index->values );
+	struct KeyList list;
+	size_t k;
+
+	list.keys = malloc( ( key_count > 0 ? key_count : 1 ) * sizeof(*list.keys) );
+	list.count = 0;
+
+	if( list.keys == NULL )
+	{
+		return NULL;
+	}
+
+	DictWalk( index->values, collectKey, &list );
+
+	struct SSItem* keys = list.keys;
+
+	if( DictIsOrdered( index->values ) )
+	{
+		for( k = 0; k < key_count / 2; k++ )
+		{
+			struct SSItem key = keys[k];
+			keys[k] = keys[key_count - 1 - k];
+			keys[key_count - 1 - k] = key;
+		}
+	}
+	else
+	{
+		SSSort( keys, key_count, threads );
+	}
+
+	return keys;
+}
+
+/**
+ * Parse through the given file_contents text, tokenizing and storing elements
+ * into the index.  The file's tokens are counted first, and each distinct term
+ * is then added to the index once.  file_contents holds file_length bytes and
+ * need not be null-terminated; escapes says how escape sequences in it are treated.
+ * The number of tokens in the file, which is its length for ranking, is stored
+ * in *tokens.
+ *
+ * Return 1 if successful, 0 otherwise, in which case the index may hold only
+ * some of the file's terms.
+ */
+int parseFileContents( IndexPtr index, uint32_t file_id, char* file_contents, size_t file_length, TKEscapeMode escapes, size_t* tokens )
+{
+	TokenizerT* tk = TKCreate( file_contents, file_length, escapes );
+
+	if( tk == NULL )
+	{
+		return 0;
+	}
+
+	int successful = countTokens( index->file_terms, tk );
+
+	*tokens = index->file_terms->tokens;
+
+	if( successful )
+	{
+		successful = addFileTerms( index, file_id, index->file_terms );
+	}
+
+	TCClear( index->file_terms );
+	TKDestroy( tk );
+
+	return successful;
+}
+
+/**
+ * Collect every file under file_path, then index them all into index.
+ * The files are sorted by path first, so the build does not depend on
+ * the order in which the directories happen to list them.  Unless
+ * index_path is NULL, the files that are unchanged since the index there
+ * was written are taken from it instead of being read (see updateIndex).
+ */
+void processInput( IndexPtr index, char* file_path, char* index_path )
+{
+	FileListPtr files = createFileList();
+	size_t i;
+
+	if( files == NULL )
+	{
+		printf("ERROR: Could not allocate the list of files\n");
+		exit( EXIT_FAILURE );
+	}
+
+	if( !collectInput( file_path, files ) )
+	{
+		printf("ERROR: Could not collect the files under %s\n", file_path);
+		exit( EXIT_FAILURE );
+	}
+
+	if( !sortFileList( files ) )
+	{
+		printf("ERROR: Could not sort the list of files\n");
+		exit( EXIT_FAILURE );
+	}
+
+	/* Each file's length is filled in by whichever thread indexes it. */
+	files->lengths = calloc( files->count > 0 ? files->count : 1, sizeof(*files->lengths) );
+
+	if( files->lengths == NULL )
+	{
+		printf("ERROR: Could not allocate the file lengths\n");
+		exit( EXIT_FAILURE );
+	}
+
+	/* The index keeps the list as its file table, so that postings can refer to files by position. */
+	index->files = files;
+
+	uint32_t* ids = malloc( ( files->count > 0 ? files->count : 1 ) * sizeof(*ids) );
+	size_t id_count = files->count;
+
+	if( ids == NULL )
+	{
+		printf("ERROR: Could not allocate the list of files to index\n");
+		exit( EXIT_FAILURE );
+	}
+
+	for( i = 0; i < files->count; i++ )
+	{
+		ids[i] = i;
+	}
+
+	if( index_path != NULL )
+	{
+		files->hashes = calloc( files->count > 0 ? files->count : 1, sizeof(*files->hashes) );
+
+		if( files->hashes == NULL )
+		{
+			printf("ERROR: Could not allocate the file hashes for the manifest\n");
+			exit( EXIT_FAILURE );
+		}
+
+		id_count = updateIndex( index, index_path, ids );
+	}
+
+	if( !buildIndex( index, files, ids, id_count, jobs ) )
+	{
+		printf("ERROR: Could not index the files\n");
+		exit( EXIT_FAILURE );
+	}
+
+	free( ids );
+}
+
+/**
+ * Obtain a read-only view of the file with the given ID in files and index its contents.
+ * A file that cannot be opened is left out of the index, as it always has been.
+ *
+ * Return 0 if the file was opened but could not be indexed, 1 otherwise.
+ */
+int processFile( IndexPtr index, FileListPtr files, uint32_t file_id )
+{
+	char* file_path = files->paths[file_id];
+
+	printf( "%s\n", file_path );
+	FileContentsPtr contents = FMOpen( file_path );
+
+	if( contents == NULL )
+	{
+		return 1;
+	}
+
+	if( files->hashes != NULL )
+	{
+		files->hashes[file_id] = HashBytes( contents->data, contents->length );
+	}
+
+	int successful = parseFileContents( index, file_id, contents->data, contents->length, escape_mode, &files->lengths[file_id] );
+	FMClose( contents );
+
+	return successful;
+}
+
+/**
+ * Index the file with the given ID in files by splitting it into the given number of byte
+ * ranges and tokenizing them all at once, one thread per range.  Each range
+ * boundary is moved forward to the next delimiter, so that no token straddles
+ * two ranges and the file's counts come out exactly as if it were read whole.
+ * If the ranges cannot be set up, the file is indexed whole by processFile.
+ *
+ * Return 0 if the file was opened but could not be indexed, 1 otherwise.
+ */
+int processLargeFile( IndexPtr index, FileListPtr files, uint32_t file_id, int ranges )
+{
+	struct RangeTask* tasks = calloc( ranges, sizeof(*tasks) );
+	int* started = calloc( ranges, sizeof(*started) );
+	int successful = tasks != NULL && started != NULL;
+	int r;
+
+	for( r = 0; successful && r < ranges; r++ )
+	{
+		tasks[r].counts = TCCreate();
+		successful = tasks[r].counts != NULL;
+	}
+
+	if( !successful )
+	{
+		for( r = 0; tasks != NULL && r < ranges; r++ )
+		{
+			TCDestroy( tasks[r].counts );
+		}
+
+		free( started );
+		free( tasks );
+
+		return processFile( index, files, file_id );
+	}
+
+	char* file_path = files->paths[file_id];
+
+	printf( "%s\n", file_path );
+	FileContentsPtr contents = FMOpen( file_path );
+
+	if( contents == NULL )
+	{
+		for( r = 0; r < ranges; r++ )
+		{
+			TCDestroy( tasks[r].counts );
+		}
+
+		free( started );
+		free( tasks );
+
+		return 1;
+	}
+
+	char* text = contents->data;
+	size_t length = contents->length;
+	char* decoded = NULL;
+
+	if( files->hashes != NULL )
+	{
+		files->hashes[file_id] = HashBytes( text, length );
+	}
+
+	/*
+	 * An escape sequence could straddle a boundary, so any decoding is done
+	 * over the whole file up front, and the ranges are tokenized as-is.
+	 */
+	if( escape_mode == TK_ESCAPES_ON || ( escape_mode == TK_ESCAPES_AUTO && length > 0 && memchr( text, '\\', length ) != NULL ) )
+	{
+		decoded = unescape_string( text, length, &length );
+
+		if( decoded != NULL )
+		{
+			text = decoded;
+		}
+		else
+		{
+			length = 0;
+			successful = 0;
+		}
+	}
+
+	char* end = text + length;
+	char* start = text;
+
+	for( r = 0; successful && r < ranges; r++ )
+	{
+		char* stop = r == ranges - 1 ? end : text + length / ranges * ( r + 1 );
+
+		if( stop < start )
+		{
+			stop = start;
+		}
+
+		while( stop < end && !is_delimiter( *stop ) )
+		{
+			stop++;
+		}
+
+		tasks[r].start = start;
+		tasks[r].length = stop - start;
+
+		start = stop;
+	}
+
+	/* The first range is done on this thread, as is any range whose thread cannot be started. */
+	for( r = 1; successful && r < ranges; r++ )
+	{
+		started[r] = pthread_create( &tasks[r].thread, NULL, runRangeTask, &tasks[r] ) == 0;
+	}
+
+	for( r = 0; successful && r < ranges; r++ )
+	{
+		if( !started[r] )
+		{
+			runRangeTask( &tasks[r] );
+		}
+	}
+
+	for( r = 1; successful && r < ranges; r++ )
+	{
+		if( started[r] )
+		{
+			pthread_join( tasks[r].thread, NULL );
+		}
+	}
+
+	for( r = 0; successful && r < ranges; r++ )
+	{
+		successful = tasks[r].successful;
+	}
+
+	for( r = 1; successful && r < ranges; r++ )
+	{
+		successful = TCMerge( tasks[0].counts, tasks[r].counts );
+	}
+
+	/* The counts point into text, so they go into the index before it is released. */
+	if( successful )
+	{
+		successful = addFileTerms( index, file_id, tasks[0].counts );
+		files->lengths[file_id] = tasks[0].counts->tokens;
+	}
+
+	for( r = 0; r < ranges; r++ )
+	{
+		TCDestroy( tasks[r].counts );
+	}
+
+	free( started );
+	free( tasks );
+	free( decoded );
+	FMClose( contents );
+
+	return successful;
+}
+
+/**
+ * Delete every spilled run, and the directory they were kept in.
+ */
+void removeRuns()
+{
+	size_t i;
+
+	for( i = 0; i < runs.count; i++ )
+	{
+		unlink( runs.paths[i] );
+		free( runs.paths[i] );
+	}
+
+	if( runs.directory != NULL )
+	{
+		rmdir( runs.directory );
+		free( runs.directory );
+	}
+
+	free( runs.paths );
+	runs.directory = NULL;
+	runs.paths = NULL;
+	runs.count = 0;
+	runs.capacity = 0;
+}
+
+/**
+ * Empty index of its terms and postings, freeing their memory at once.  The
+ * file table and file_terms are kept.
+ */
+void resetIndex( IndexPtr index )
+{
+	DictDestroy( index->values );
+	ArenaDestroy( index->arena );
+
+	index->values = DictCreate( dictionary_backend );
+	index->arena = ArenaCreate();
+}
+
+/**
+ * Add to index the postings in old of the files marked in kept, under their
+ * IDs in index's file table, which are matched to old's by path.  Every kept
+ * file that has any tokens must be in old.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+int reuseIndex( IndexPtr index, QueryIndexPtr old, unsigned char* kept )
+{
+	FileListPtr files = index->files;
+	size_t old_count = QEFileCount( old );
+	size_t term_count = QETermCount( old );
+	size_t i;
+	size_t t;
+
+	/* Each old ID's new one, or UINT32_MAX for a file whose postings are not kept. */
+	uint32_t* new_ids = malloc( ( old_count > 0 ? old_count : 1 ) * sizeof(*new_ids) );
+	unsigned char* found = calloc( files->count > 0 ? files->count : 1, sizeof(*found) );
+	int successful = new_ids != NULL && found != NULL;
+
+	for( i = 0; successful && i < old_count; i++ )
+	{
+		const char* path = QEPath( old, i );
+		size_t id = path != NULL ? findFile( files, path ) : files->count;
+
+		new_ids[i] = UINT32_MAX;
+
+		if( id < files->count && kept[id] )
+		{
+			new_ids[i] = id;
+			found[id] = 1;
+		}
+	}
+
+	/* A kept file missing from old, which the manifest says has tokens, would lose its postings. */
+	for( i = 0; successful && i < files->count; i++ )
+	{
+		if( kept[i] && !found[i] && files->lengths[i] > 0 )
+		{
+			successful = 0;
+		}
+	}
+
+	PostingPtr postings = NULL;
+	size_t postings_capacity = 0;
+
+	/* The postings count towards the memory budget as if the files had been read. */
+	index->budget = mem_limit;
+
+	for( t = 0; successful && t < term_count; t++ )
+	{
+		size_t term_length;
+		size_t count;
+		const char* term = QETerm( old, t, &term_length, &count );
+		TermPtr entry = NULL;
+		size_t p;
+
+		/* A damaged old index is not reused; the files are read again instead. */
+		if( term == NULL || count > old_count )
+		{
+			successful = 0;
+			break;
+		}
+
+		if( count > postings_capacity )
+		{
+			postings_capacity = count;
+			free( postings );
+			postings = malloc( postings_capacity * sizeof(*postings) );
+
+			if( postings == NULL )
+			{
+				successful = 0;
+				break;
+			}
+		}
+
+		if( !QEPostings( old, t, postings ) )
+		{
+			successful = 0;
+			break;
+		}
+
+		for( p = 0; successful && p < count; p++ )
+		{
+			if( postings[p].file_id >= old_count )
+			{
+				successful = 0;
+				break;
+			}
+
+			uint32_t id = new_ids[postings[p].file_id];
+
+			if( id == UINT32_MAX )
+			{
+				continue;
+			}
+
+			/* Only a term that some kept file still has is added. */
+			if( entry == NULL )
+			{
+				uint64_t hash = HashBytes( term, term_length );
+
+				entry = findTerm( index, hash, (char*)term, term_length );
+
+				if( entry == NULL )
+				{
+					entry = addTerm( index, hash, (char*)term, term_length );
+				}
+
+				if( entry == NULL )
+				{
+					successful = 0;
+					break;
+				}
+			}
+
+			successful = PLAppend( &entry->files, index->arena, id, postings[p].appearances );
+		}
+
+		spillIfFull( index, jobs );
+	}
+
+	free( postings );
+	free( found );
+	free( new_ids );
+
+	return successful;
+}
+
+/**
+ * Thread entry point for a struct RangeTask: count the tokens of the range.
+ */
+void* runRangeTask( void* task )
+{
+	struct RangeTask* self = task;
+
+	/* With escapes off the tokenizer reads the range in place, so the counts stay valid once it is gone. */
+	TokenizerT* tk = TKCreate( self->start, self->length, TK_ESCAPES_OFF );
+
+	self->successful = tk != NULL && countTokens( self->counts, tk );
+
+	if( tk != NULL )
+	{
+		TKDestroy( tk );
+	}
+
+	return NULL;
+}
+
+/*
+ * A file's path, size and modification time, gathered up so that the arrays of a FileList can be sorted together.
+ */
+struct SizedPath
+{
+	char* path;
+	size_t size;
+	int64_t mtime;
+};
+
+/**
+ * qsort comparator for an array of struct SizedPath.
+ */
+int sizedPathCompare( const void* a, const void* b )
+{
+	return filePathCompare( ((struct SizedPath*)a)->path, ((struct SizedPath*)b)->path );
+}
 
 /**
- * Iterate through the list of files.  If the given file is already in the list,
- * increase its number of appearances.  If the given file is not in the list,
- * add it.
+ * Sort the given list of files by path.
  *
- * Return 1 if successfully updated, 0 otherwise.
+ * Return 1 if successful, 0 otherwise.
  */
-int addFile( SortedListPtr files, char* file_path, TermPtr t )
+int sortFileList( FileListPtr files )
 {
-	Node file_node = files->head;
-	int comparison = 0;
-	FilePtr curr_file = NULL;
+	struct SizedPath* entries = malloc( ( files->count > 0 ? files->count : 1 ) * sizeof(*entries) );
+	size_t i;
 
-	while( file_node != NULL )
+	if( entries == NULL )
 	{
-		curr_file = (FilePtr)(file_node->object);
-
-		comparison = strcmp( file_path, curr_file->file_path );
-
-		if( comparison == 0 )
-		{
-			curr_file->appearances++;
-			shiftNodeUp( files, curr_file );//This may have errors
-			return 1;
-		}
+		return 0;
+	}
 
-		file_node = file_node->next;
+	for( i = 0; i < files->count; i++ )
+	{
+		entries[i].path = files->paths[i];
+		entries[i].size = files->sizes[i];
+		entries[i].mtime = files->mtimes[i];
 	}
 
-	int successful = insertFileIntoList( files, file_path );
+	qsort( entries, files->count, sizeof(*entries), sizedPathCompare );
 
-	if( successful )
+	for( i = 0; i < files->count; i++ )
 	{
-		t->number_of_files++;
+		files->paths[i] = entries[i].path;
+		files->sizes[i] = entries[i].size;
+		files->mtimes[i] = entries[i].mtime;
 	}
 
-	return successful;
+	free( entries );
+
+	return 1;
 }
 
 /**
- * Create a TermPtr and add it to the values hashtable while also
- * adding the associated file_path to the keys list.
+ * Spill index to disk, if it takes more than its budget.  If it cannot be
+ * spilled, it is kept in memory from then on, without a budget.
  *
- * Return 1 if successfully added, 0 otherwise.
+ * Return 1 if index is within its budget now, 0 otherwise.
  */
-int addTerm(char* new_term, char* file_path )
+int spillIfFull( IndexPtr index, int threads )
 {
-	/* Initialize TermPtr containing the new term and its list of associated files. */
-	TermPtr t = createTermPtr();
-	t->term_length = strlen(new_term);
-	t->term = malloc( t->term_length );
-	strcpy( t->term, new_term );
-	t->files = SLCreate(fileCompare);
-
-	/* Insert the FilePtr into the term's list of associated files. */
-	int successful = insertFileIntoList( t->files, file_path );
-
-	/* If insert is unsuccessful, perform cleanup. */
-	if( !successful )
+	if( index->budget == 0 || indexBytes( index ) <= index->budget )
 	{
-		free(t->files);
-		free(t);
+		return 1;
+	}
 
+	if( !spillIndex( index, threads ) )
+	{
+		fprintf( stderr, "WARNING: could not spill the index to disk; keeping it in memory\n" );
+		index->budget = 0;
 		return 0;
 	}
 
-	t->number_of_files++;
-
-	SLInsert(keys, new_term);
-	HASH_ADD_KEYPTR( hh, values, new_term, strlen(new_term), t );
-
 	return 1;
 }
 
-void cleanup()
+/**
+ * Write every term of index, in descending order, with its postings, to a
+ * new sorted run, and then empty index.  The keys are sorted on threads
+ * threads.  This may be called from several threads at once, each with its
+ * own index.
+ *
+ * Return 1 if successful, 0 otherwise, in which case index is unchanged.
+ */
+int spillIndex( IndexPtr index, int threads )
 {
-	SortedListIteratorPtr key_iter = SLCreateIterator( keys );
+	size_t key_count = DictCount( index->values );
+
+	if( key_count == 0 )
+	{
+		return 1;
+	}
 
-	while( SLHasNext( key_iter ) )
+	struct SSItem* keys = orderedKeys( index, threads );
+
+	if( keys == NULL )
 	{
-		char* key = SLNextItem( key_iter );
-		TermPtr t = findTerm( key );
+		return 0;
+	}
+
+	/* Name the run, making the directory for the runs if this is the first. */
+	pthread_mutex_lock( &runs.lock );
 
-		SortedListIteratorPtr file_iter = SLCreateIterator( t->files );
+	if( runs.directory == NULL )
+	{
+		char* base = temp_dir != NULL ? temp_dir : getenv( "TMPDIR" );
 
-		while( SLHasNext( file_iter ) )
+		if( base == NULL || *base == '\0' )
 		{
-			FilePtr f = SLNextItem( file_iter );
-			free( f->file_path );
-			free( f );
+			base = "/tmp";
 		}
 
-		SLDestroyIterator( file_iter );
-		SLDestroy( t->files );
+		char* directory = malloc( strlen( base ) + sizeof("/index-XXXXXX") );
+
+		if( directory != NULL )
+		{
+			sprintf( directory, "%s/index-XXXXXX", base );
 
-		free( t->term );
-		deleteTerm( key );
+			if( mkdtemp( directory ) == NULL )
+			{
+				free( directory );
+				directory = NULL;
+			}
+		}
 
-		free( key );
+		runs.directory = directory;
 	}
 
-	SLDestroyIterator( key_iter );
-	SLDestroy( keys );
-}
-
-FilePtr createFilePtr()
-{
-	FilePtr f = malloc(sizeof(*f));
-	f->file_path = NULL;
-	f->file_path_length = 0;
-	f->appearances = 0;
+	char* path = NULL;
 
-	return f;
-}
+	if( runs.directory != NULL )
+	{
+		path = malloc( strlen( runs.directory ) + 32 );
 
-TermPtr createTermPtr()
-{
-	TermPtr t = malloc(sizeof(*t));
-	t->term = NULL;
-	t->term_length = 0;
-	t->files = NULL;
-	t->number_of_files = 0;
+		if( path != NULL )
+		{
+			sprintf( path, "%s/run-%zu", runs.directory, runs.started++ );
+		}
+	}
 
-	return t;
-}
+	pthread_mutex_unlock( &runs.lock );
 
-void deleteTerm( char* target )
-{
-	TermPtr t = findTerm( target );
+	RunWriterPtr writer = path != NULL ? RFCreate( path ) : NULL;
 
-	if( t != NULL )
+	if( writer == NULL )
 	{
-		HASH_DEL( values, t );
-		SLRemove( keys, target );
+		free( path );
+		free( keys );
+		return 0;
 	}
-}
 
-/**
- * Compares values a and b, and return -1 if a < b, 0 if a == b, 1 if a > b.
- * This function assumes a and b are of type FilePtr, and the comparison is made
- * on the struct's "appearances" size_t counter.
- */
-int fileCompare( void* a, void* b )
-{
-	size_t a_int = ((FilePtr)a)->appearances;
-	size_t b_int = ((FilePtr)b)->appearances;
+	PostingPtr postings = NULL;
+	size_t postings_capacity = 0;
+	int successful = 1;
+	size_t k;
 
-	return a_int - b_int;
-}
+	for( k = 0; successful && k < key_count; k++ )
+	{
+		TermPtr t = keys[k].value;
 
-int filePathCompare( char* a, char* b )
-{
-	return strcmp( a, b );
-}
+		if( t->files.count > postings_capacity )
+		{
+			postings_capacity = t->files.count;
+			free( postings );
+			postings = malloc( postings_capacity * sizeof(*postings) );
 
-TermPtr findTerm( char* target )
-{
-	TermPtr t = NULL;
-	HASH_FIND_STR( values, target, t );
-	return t;
-}
+			if( postings == NULL )
+			{
+				successful = 0;
+				break;
+			}
+		}
 
-/*
-* Description: retrieves the entire file contents as a string and places it in a fileString variable
-* Parameters: fileName - the filename to retrieve the data from
-* Returns: fileString if the string is successfully copied, NULL otherwise
-*/
-char *getFileContents(char* file_path )
-{
-	printf("%s\n", file_path );
-	FILE *fp = fopen(file_path, "r");
+		PLDecode( &t->files, postings );
+		successful = RFWrite( writer, t->term, t->term_length, postings, t->files.count );
+	}
 
-	if (fp == NULL)
+	if( !RFClose( writer ) )
 	{
-		return NULL;
+		successful = 0;
 	}
 
-	fseek(fp, 0, SEEK_END);
-	size_t fileSize = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
+	free( postings );
+	free( keys );
 
-	char *fileString = (char *) malloc(fileSize);
-	size_t result = fread(fileString, 1, fileSize, fp);
-	fclose(fp);
+	if( !successful )
+	{
+		unlink( path );
+		free( path );
+		return 0;
+	}
 
-	if (result == 0) {
-		return NULL;
+	/* Only a complete run is added to the list. */
+	pthread_mutex_lock( &runs.lock );
+
+	if( runs.count == runs.capacity )
+	{
+		size_t capacity = runs.capacity > 0 ? runs.capacity * 2 : 16;
+		char** paths = realloc( runs.paths, capacity * sizeof(*paths) );
+
+		if( paths == NULL )
+		{
+			pthread_mutex_unlock( &runs.lock );
+			unlink( path );
+			free( path );
+			return 0;
+		}
+
+		runs.paths = paths;
+		runs.capacity = capacity;
 	}
 
-	return fileString;
+	runs.paths[runs.count++] = path;
+
+	pthread_mutex_unlock( &runs.lock );
+
+	resetIndex( index );
+
+	return 1;
 }
 
 /**
- * Create a new FilePtr object wrapping the given file_path, and then
- * insert the FilePtr into the given list of files.
+ * Bring index up to date from the index at index_path, by the manifest kept
+ * beside it.  A file whose size and modification time are as the manifest
+ * has them, or whose size is and whose contents hash the same, is unchanged:
+ * its postings and length are taken from the old index.  The IDs of the
+ * other files, new or changed, are written to ids to be read again; the
+ * postings of deleted files are dropped with the old index.  If there is no
+ * manifest, or it was written with another escape mode, or the old index
+ * cannot be read, every file is read again.
  *
- * Return 1 if successful; 0 otherwise.
+ * Return the number of IDs written to ids.
  */
-int insertFileIntoList( SortedListPtr files, char* file_path)
+size_t updateIndex( IndexPtr index, char* index_path, uint32_t* ids )
 {
-	FilePtr f = createFilePtr();
-	f->file_path_length = strlen(file_path);
-	f->file_path = malloc(f->file_path_length);
-	strcpy( f->file_path, file_path );
-	f->appearances++;
+	FileListPtr files = index->files;
+	char* manifest_path = ManifestPath( index_path );
+	ManifestPtr manifest = manifest_path != NULL ? ManifestRead( manifest_path ) : NULL;
+	QueryIndexPtr old = NULL;
+	size_t i;
 
-	int successful = SLInsert( files, f );
+	free( manifest_path );
 
-	if( !successful )
+	/* Files tokenized another way would have other terms, so none of the old postings can be kept. */
+	if( manifest != NULL && manifest->escapes == escape_mode )
 	{
-		free( f );
-		return 0;
+		old = QEOpen( index_path );
 	}
 
-	return 1;
-}
+	if( old == NULL )
+	{
+		printf("No usable index and manifest at %s; indexing every file\n", index_path);
 
-/**
- * Compare keys a and b, and return -1 if a < b, 0 if a == b, 1 if a > b.
- * This function assumes a and b are of type char*, and so comparison is
- * based on lexicographical ordering.
- */
-int keyCompare( void* a, void* b )
-{
-	char* a_string = a;
-	char* b_string = b;
+		if( manifest != NULL )
+		{
+			ManifestDestroy( manifest );
+		}
 
-	return strcmp( a_string, b_string );
-}
+		for( i = 0; i < files->count; i++ )
+		{
+			ids[i] = i;
+		}
+		return files->count;
+	}
 
-/**
- * Parse through the given file_contents text, tokenizing and storing elements
- * as necessary.
- */
-void parseFileContents( char* file_path, char* file_contents )
-{
-	TermPtr t;
-	TokenizerT* tk = TKCreate( file_contents );
-	char* token = TKGetNextToken( tk );
+	unsigned char* kept = calloc( files->count > 0 ? files->count : 1, sizeof(*kept) );
+	size_t id_count = 0;
+	size_t unchanged = 0;
+	size_t changed = 0;
 
-	while( token != NULL )
+	for( i = 0; i < files->count && kept != NULL; i++ )
 	{
-		t = findTerm( token );
-		if( t != NULL )
+		ManifestEntryPtr entry = ManifestFind( manifest, files->paths[i] );
+		uint64_t hash;
+
+		/* A file that was only touched is read once to hash it, which is still cheaper than indexing it. */
+		if( entry != NULL && entry->size == files->sizes[i] &&
+			( entry->mtime == files->mtimes[i] || ( hashFile( files->paths[i], &hash ) && hash == entry->hash ) ) )
 		{
-			int successful = addFile( t->files, file_path, t );
-			if( successful )
-			{
-				//t->number_of_files++;
-			}
-			else
-			{
-				//TODO handle failure
-			}
+			kept[i] = 1;
+			files->lengths[i] = entry->length;
+			files->hashes[i] = entry->hash;
+			unchanged++;
 		}
 		else
 		{
-			int successful = addTerm( token, file_path );
-			if( !successful )
-			{
-				//TODO handle failure
-			}
+			ids[id_count++] = i;
+			changed += entry != NULL;
 		}
+	}
+
+	printf("%zu files unchanged, %zu changed, %zu new, %zu deleted\n", unchanged, changed, id_count - changed, manifest->count - unchanged - changed);
+
+	if( kept == NULL || !reuseIndex( index, old, kept ) )
+	{
+		printf("WARNING: could not reuse the index at %s; indexing every file\n", index_path);
+
+		removeRuns();
+		resetIndex( index );
 
-		token = TKGetNextToken( tk );
+		for( i = 0; i < files->count; i++ )
+		{
+			ids[i] = i;
+			files->lengths[i] = 0;
+		}
+		id_count = files->count;
 	}
 
-	TKDestroy( tk );
+	free( kept );
+	QEClose( old );
+	ManifestDestroy( manifest );
+
+	return id_count;
 }
 
 /**
- * Parse the file_path to discover whether or not it is a directory.
- * If the given path is a directory, recursively loop through its contents.
- * If the given path is a file, forward it to functions to read its contents.
+ * RFMerge callback for writeFile: append one term to the binary index being
+ * written by writer.
  */
-void processInput( char* file_path )
+int writeBinaryTerm( void* writer, FILE* file, char* term, size_t term_length, PostingPtr postings, size_t count )
 {
-	DIR* dir = opendir( file_path );
+	return BIWrite( writer, term, term_length, postings, count );
+}
+
+/**
+ * Write the index to a new file at file_path, one <list> block per term in
+ * descending order of the terms, or in the binary format if binary_format is
+ * set.  If parts of the index were spilled to disk during the build, what is
+ * left in memory is spilled too, and the runs are merged into the file.
+ */
+void writeFile( IndexPtr index, char* file_path )
+{
+	FILE* new_file = NULL;
+	BIWriterPtr writer = NULL;
+	RFMergeFn emit = writeTextTerm;
+	void* context = index->files;
+	int successful = 1;
+
+	if( binary_format )
+	{
+		writer = BICreate( file_path, index->files->lengths, index->files->count );
+		emit = writeBinaryTerm;
+		context = writer;
+	}
+	else
+	{
+		new_file = fopen( file_path, "w" );
+	}
+
+	if( new_file == NULL && writer == NULL )
+	{
+		printf("ERROR: Could not create %s\n", file_path);
+		removeRuns();
+		exit( EXIT_FAILURE );
+	}
 
-	/* If the path is a directory... */
-	if( dir != NULL )
+	if( runs.count > 0 )
 	{
-		/* ... iterate through its contents. */
-		struct dirent* entry = readdir( dir );
-		while( entry != NULL )
+		/* A binary index's dictionary is built in term order by a single writer, so its merge runs on one thread. */
+		if( !spillIndex( index, jobs ) ||
+			!RFMerge( runs.paths, runs.count, binary_format ? 1 : jobs, runs.directory, new_file, emit, context ) )
 		{
-			DIR* dir_test = opendir( entry->d_name );
+			printf("ERROR: Could not merge the spilled runs into %s\n", file_path);
+			successful = 0;
+		}
 
-			/* If the directory contains subdirectories... */
-			if( dir_test != NULL )
-			{
-				/* ...recurse on them. */
-				processInput( entry->d_name );
-				closedir( dir_test );
-			}
+		removeRuns();
+	}
+	else
+	{
+		size_t key_count = DictCount( index->values );
+		struct SSItem* keys = orderedKeys( index, jobs );
+		size_t k;
 
-			/* Else parse and store the contents of the file. */
-			else
+		if( keys == NULL && key_count > 0 )
+		{
+			successful = 0;
+		}
+
+		/* Each term's postings are decoded into here, which grows to fit the longest list. */
+		PostingPtr postings = NULL;
+		size_t postings_capacity = 0;
+
+		for( k = 0; k < key_count && successful; k++ )
+		{
+			TermPtr t = keys[k].value;
+
+			if( t->files.count > postings_capacity )
 			{
-				char* file_contents = getFileContents( entry->d_name );
-				parseFileContents( entry->d_name, file_contents );
-				free( file_contents );
+				postings_capacity = t->files.count;
+				free( postings );
+				postings = malloc( postings_capacity * sizeof(*postings) );
+
+				if( postings == NULL )
+				{
+					successful = 0;
+					break;
+				}
 			}
 
-			entry = readdir( dir );
+			PLDecode( &t->files, postings );
+			successful = emit( context, new_file, t->term, t->term_length, postings, t->files.count );
+		}
+
+		if( !successful )
+		{
+			printf("ERROR: Could not write the index to %s\n", file_path);
 		}
 
-		closedir( dir );
+		free( postings );
+		free( keys );
 	}
 
-	/* Else parse and store the contents of the file. */
-	else
+	if( writer != NULL )
 	{
-		printf( " %s\n", file_path );
-		char* file_contents = getFileContents( file_path );
-		if( file_contents == NULL )
+		if( !BIFinish( writer, index->files->paths ) && successful )
 		{
-			//TODO handle error
+			printf("ERROR: Could not write the index to %s\n", file_path);
+			successful = 0;
 		}
-		parseFileContents( file_path, file_contents );
-		free( file_contents );
+	}
+	else
+	{
+		fclose( new_file );
+	}
+
+	if( !successful )
+	{
+		exit( EXIT_FAILURE );
 	}
 }
 
-void writeFile( char* file_path )
+/**
+ * Write one term's <list> block to file.  postings holds count postings, in
+ * the order the files were read; they are put in order here.
+ */
+void writeList( FILE* file, FileListPtr files, char* term, PostingPtr postings, size_t count )
 {
-	FILE* new_file = fopen( file_path, "w" );
-	SortedListIteratorPtr key_iter = SLCreateIterator( keys );
+	fputs("<list> ", file);
+	fputs(term, file);
+	fputs("\n", file);
 
-	while( SLHasNext( key_iter ) )
+	PLSort( postings, count );
+
+	int i = 0;
+	size_t p;
+	for( p = 0; p < count; p++ )
 	{
-		char* key = SLNextItem( key_iter );
-		TermPtr t = findTerm( key );
+		if( i == 5 )
+		{
+			i = 0;
+			fputs("\n", file);
+		}
 
-		fputs("<list> ", new_file);
-		fputs(key, new_file);
-		fputs("\n", new_file);
+		PostingPtr f = &postings[p];
+		fputs( files->paths[f->file_id], file );
+		fputs( " ", file );
 
-		SortedListIteratorPtr file_iter = SLCreateIterator( t->files );
+		char appearances[20];
+		snprintf(appearances, 20, "%zd", f->appearances );
+		fputs(appearances, file);
+		fputs(" ", file );
 
-		int i = 0;
-		while( SLHasNext( file_iter ) )
-		{
-			if( i == 5 )
-			{
-				i = 0;
-				fputs("\n", new_file);
-			}
+		i++;
+	}
+
+	fputs("\n", file);
+	fputs("</list>", file);
+	fputs("\n", file);
+}
+
+/**
+ * Write the manifest of the index at index_path, which describes every file
+ * of files as it was indexed, in place of any old one.
+ */
+void writeManifest( FileListPtr files, char* index_path )
+{
+	char* manifest_path = ManifestPath( index_path );
+	ManifestWriterPtr writer = manifest_path != NULL ? ManifestCreate( manifest_path, escape_mode ) : NULL;
+	int successful = writer != NULL;
+	size_t i;
 
-			FilePtr f = SLNextItem( file_iter );
-			fputs( f->file_path, new_file );
-			fputs( " ", new_file );
+	for( i = 0; i < files->count && successful; i++ )
+	{
+		struct ManifestEntry entry = { files->paths[i], files->sizes[i], files->mtimes[i], files->hashes[i], files->lengths[i] };
 
-			char appearances[20];
-			snprintf(appearances, 20, "%zd", f->appearances );
-			fputs(appearances, new_file);
-			fputs(" ", new_file );
+		successful = ManifestAdd( writer, &entry );
+	}
 
-			i++;
-		}
+	if( writer != NULL && !ManifestFinish( writer ) )
+	{
+		successful = 0;
+	}
+
+	if( !successful )
+	{
+		printf("ERROR: Could not write the manifest of %s\n", index_path);
+		free( manifest_path );
+		exit( EXIT_FAILURE );
+	}
+
+	free( manifest_path );
+}
+
+/**
+ * RFMerge callback for writeFile: write one term's <list> block to file,
+ * with paths from the FileList files.
+ */
+int writeTextTerm( void* files, FILE* file, char* term, size_t term_length, PostingPtr postings, size_t count )
+{
+	writeList( file, files, term, postings, count );
 
-		fputs("\n", new_file);
-		fputs("</list>", new_file);
-		fputs("\n", new_file);
+	return !ferror( file );
+}
 
-		SLDestroyIterator( file_iter );
+/**
+ * Parse the leading command line options into the global settings.
+ *
+ * Return the index of the first non-option argument, or -1 if an option is invalid.
+ */
+int parseOptions( int argc, char** argv )
+{
+	static struct option long_options[] =
+	{
+		{ "dictionary", required_argument, NULL, 'd' },
+		{ "escapes", required_argument, NULL, 'e' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "incremental", no_argument, NULL, 'i' },
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "mem-limit", required_argument, NULL, 'm' },
+		{ "stats", no_argument, NULL, 's' },
+		{ "split-size", required_argument, NULL, 'S' },
+		{ "temp-dir", required_argument, NULL, 'T' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int option;
+	char* end;
+
+	while( ( option = getopt_long( argc, argv, "d:e:f:ij:m:sS:T:", long_options, NULL ) ) != -1 )
+	{
+		switch( option )
+		{
+			case 'd':
+				if( strcmp( optarg, "hash" ) == 0 )
+				{
+					dictionary_backend = DICT_HASH;
+				}
+				else if( strcmp( optarg, "art" ) == 0 )
+				{
+					dictionary_backend = DICT_ART;
+				}
+				else
+				{
+					printf("ERROR: --dictionary must be one of hash or art\n");
+					return -1;
+				}
+				break;
+
+			case 'e':
+				if( strcmp( optarg, "off" ) == 0 )
+				{
+					escape_mode = TK_ESCAPES_OFF;
+				}
+				else if( strcmp( optarg, "on" ) == 0 )
+				{
+					escape_mode = TK_ESCAPES_ON;
+				}
+				else if( strcmp( optarg, "auto" ) == 0 )
+				{
+					escape_mode = TK_ESCAPES_AUTO;
+				}
+				else
+				{
+					printf("ERROR: --escapes must be one of off, on or auto\n");
+					return -1;
+				}
+				break;
+
+			case 'f':
+				if( strcmp( optarg, "text" ) == 0 )
+				{
+					binary_format = 0;
+				}
+				else if( strcmp( optarg, "binary" ) == 0 )
+				{
+					binary_format = 1;
+				}
+				else
+				{
+					printf("ERROR: --format must be one of binary or text\n");
+					return -1;
+				}
+				break;
+
+			case 'i':
+				incremental = 1;
+				break;
+
+			case 'j':
+				jobs = strtol( optarg, &end, 10 );
+				if( *optarg == '\0' || *end != '\0' || jobs < 1 )
+				{
+					printf("ERROR: --jobs must be a positive number\n");
+					return -1;
+				}
+				break;
+
+			case 'm':
+				mem_limit = strtoull( optarg, &end, 10 );
+				if( *optarg == '\0' || *end != '\0' )
+				{
+					printf("ERROR: --mem-limit must be a number of bytes\n");
+					return -1;
+				}
+				break;
+
+			case 's':
+				print_stats = 1;
+				break;
+
+			case 'S':
+				split_size = strtoull( optarg, &end, 10 );
+				if( *optarg == '\0' || *end != '\0' )
+				{
+					printf("ERROR: --split-size must be a number of bytes\n");
+					return -1;
+				}
+				break;
+
+			case 'T':
+				temp_dir = optarg;
+				break;
+
+			default:
+				return -1;
+		}
 	}
 
-	SLDestroyIterator( key_iter );
-	fclose(new_file);
+	return optind;
+}
+
+void printUsage()
+{
+	printf("USAGE: index [options] <inverted-index file name> <directory or file name>\n");
+	printf("OPTIONS:\n");
+	printf("  -d, --dictionary=hash|art  keep the terms in a hash table or in an adaptive\n");
+	printf("                             radix tree (default %s)\n", DICT_DEFAULT_BACKEND == DICT_ART ? "art" : "hash");
+	printf("  -e, --escapes=off|on|auto  decode backslash escapes never, always, or only\n");
+	printf("                             in files that contain a backslash (default auto)\n");
+	printf("  -f, --format=binary|text   write the index as text, or in a binary format that\n");
+	printf("                             can be mapped and searched in place (default text)\n");
+	printf("  -i, --incremental          if the index exists, bring it up to date, reading only\n");
+	printf("                             the files that changed since it was written, as\n");
+	printf("                             recorded in its manifest, <index>%s\n", MANIFEST_SUFFIX);
+	printf("  -j, --jobs=N               index files on N threads (default 1)\n");
+	printf("  -m, --mem-limit=BYTES      spill the terms held in memory to disk as sorted runs\n");
+	printf("                             whenever they take more than BYTES, and merge the\n");
+	printf("                             runs at the end (default 0, no limit)\n");
+	printf("  -s, --stats                report each thread's share of the work\n");
+	printf("  -S, --split-size=BYTES     with -j, split files of at least BYTES bytes across\n");
+	printf("                             all threads (default 64 MiB, 0 to disable)\n");
+	printf("  -T, --temp-dir=DIR         spill runs under DIR (default $TMPDIR, or /tmp)\n");
 }
 
 int main( int argc, char** argv )
 {
+	int first_argument = parseOptions( argc, argv );
+
+	if( first_argument < 0 )
+	{
+		printUsage();
+		exit(EXIT_FAILURE);
+	}
+
 	/* Check input values. */
-	if (argc != 3) {
+	if (argc - first_argument != 2) {
 		printf("ERROR: Invalid number of arguments\n");
-		printf("USAGE: index <inverted-index file name> <directory or file name>\n");
+		printUsage();
 		exit(EXIT_FAILURE);
 	}
 
-	FILE *fp = fopen(argv[1], "r");
+	char* index_path = argv[ first_argument ];
+	char* input_path = argv[ first_argument + 1 ];
+
+	FILE *fp = fopen(index_path, "r");
 
 	if( fp != NULL )
 	{
 		fclose( fp );
-		printf("A file with your inverted-index file name already exists.\n");
-		printf("Please restart program and enter a new name.\n");
-		exit( EXIT_FAILURE );
+
+		if( !incremental )
+		{
+			printf("A file with your inverted-index file name already exists.\n");
+			printf("Please restart program and enter a new name, or use --incremental.\n");
+			exit( EXIT_FAILURE );
+		}
+	}
+
+	if( incremental )
+	{
+		/* An index kept in the tree it indexes must not index itself, or its manifest, on the next run. */
+		excludeFile( index_path, "" );
+		excludeFile( index_path, ".new" );
+		excludeFile( index_path, MANIFEST_SUFFIX );
+		excludeFile( index_path, MANIFEST_SUFFIX ".new" );
 	}
 
-	/* Initialize key list and values hash table. */
-	keys = SLCreate(keyCompare);
-	values = NULL;
+	/* Initialize the index and its term dictionary. */
+	IndexPtr index = createIndex();
+
+	if( index == NULL )
+	{
+		printf("ERROR: Could not create the index\n");
+		exit( EXIT_FAILURE );
+	}
 
-	char* x = argv[ 2 ];
-	printf("%s\n", x);
+	printf("%s\n", input_path);
 
 	/* Iterate and sort contents of files as necessary. */
-	processInput( argv[ 2 ] );
+	processInput( index, input_path, incremental ? index_path : NULL );
+
+	if( incremental )
+	{
+		/* The new index only replaces the old once it is complete, and the manifest follows it. */
+		char* temp_path = malloc( strlen( index_path ) + sizeof(".new") );
+
+		if( temp_path == NULL )
+		{
+			printf("ERROR: out of memory\n");
+			exit( EXIT_FAILURE );
+		}
+
+		sprintf( temp_path, "%s.new", index_path );
 
-	/* Generate file with sorted items as its content. */
-	writeFile( argv[ 1 ] );
+		writeFile( index, temp_path );
+
+		if( rename( temp_path, index_path ) != 0 )
+		{
+			printf("ERROR: Could not replace %s\n", index_path);
+			unlink( temp_path );
+			exit( EXIT_FAILURE );
+		}
+
+		writeManifest( index->files, index_path );
+		free( temp_path );
+	}
+	else
+	{
+		/* Generate file with sorted items as its content. */
+		writeFile( index, index_path );
+	}
 
 	/* Destroy contents of Index. (i.e. perform cleanup) */
-	cleanup();
+	destroyIndex( index );
 
 	return 0;
 }
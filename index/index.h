@@ -1,25 +1,73 @@
 #ifndef index_index_h
 #define index_index_h
 
-#include "sorted-list.h"
-#include "uthash.h"
+#include <stdint.h>
+#include "arena.h"
+#include "dictionary.h"
+#include "postings.h"
+#include "term-counts.h"
 
-struct File
-{
-	char* file_path;
-	size_t file_path_length;
-	size_t appearances;
-};
-typedef struct File* FilePtr;
+/* Terms are aligned to, and sized to fill, one cache line. */
+#define TERM_ALIGNMENT 64
+
+/* The room in a Term for a short term's text and its terminator; longer terms are kept in the index's arena. */
+#define TERM_INLINE_SIZE ( TERM_ALIGNMENT - sizeof(char*) - sizeof(struct PostingList) - sizeof(uint32_t) )
 
 struct Term
 {
+	/* The term's text, null-terminated: either inline_term or a copy in the arena. */
 	char* term;
-	size_t term_length;
-	SortedListPtr files;
-	size_t number_of_files;
-	UT_hash_handle hh;
+	struct PostingList files;
+	uint32_t term_length;
+	char inline_term[TERM_INLINE_SIZE];
 };
 typedef struct Term* TermPtr;
 
+/*
+ * A growable list of paths of files to be indexed, along with their sizes
+ * and modification times.  Once sorted, a file's position in the list is its
+ * ID.
+ */
+struct FileList
+{
+	char** paths;
+	size_t* sizes;
+
+	/* Each file's modification time, in nanoseconds since the epoch; 0 for a file that is not regular. */
+	int64_t* mtimes;
+
+	/* The number of tokens in each file, recorded as it is indexed; NULL until the build starts. */
+	size_t* lengths;
+
+	/* The HashBytes hash of each file's contents, for the manifest; NULL unless the build is incremental. */
+	uint64_t* hashes;
+
+	size_t count;
+	size_t capacity;
+};
+typedef struct FileList* FileListPtr;
+
+/*
+ * An inverted index: a dictionary from each key to its Term.  Unless the
+ * dictionary keeps its keys in order, they are sorted when the index is
+ * written.
+ */
+struct Index
+{
+	DictionaryPtr values;
+
+	/* Owns every term, term string and postings array of the index. */
+	ArenaPtr arena;
+
+	/* Scratch table in which one file's tokens are counted before being added. */
+	TermCountsPtr file_terms;
+
+	/* The file table: every indexed path, held once and looked up by file ID. */
+	FileListPtr files;
+
+	/* Once the index takes more than this many bytes, it is spilled to disk as a sorted run; 0 for no limit. */
+	size_t budget;
+};
+typedef struct Index* IndexPtr;
+
 #endif
@@ -1,10 +1,243 @@
+/*
+ * main.c
+ *
+ * search: answers boolean queries (see query.h) over an index written by
+ * cs214index, in either format.  Each line of the standard input is a query;
+ * the paths of the files that match it are printed, then how many there were
+ * and how long the query took, not counting the printing.  With --top, each
+ * query is ranked instead, and the best files are printed with their scores.
+ */
 #include <stdio.h>
-#include "index.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+#include "query.h"
 
-int main(int argc, char **argv)
+double elapsedMilliseconds( struct timespec* start );
+int parseOptions( int argc, char** argv );
+void printUsage();
+void runQuery( QueryIndexPtr index, char* query );
+void runRankedQuery( QueryIndexPtr index, char* query );
+
+/* 1 if only the number of matching files is printed for each query. */
+int count_only = 0;
+
+/* How many of the best files a ranked query keeps; 0 if queries are boolean. */
+size_t top = 0;
+
+/**
+ * Return the milliseconds since start.
+ */
+double elapsedMilliseconds( struct timespec* start )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return ( now.tv_sec - start->tv_sec ) * 1e3 + ( now.tv_nsec - start->tv_nsec ) / 1e6;
+}
+
+/**
+ * Parse the leading command line options into the global settings.
+ *
+ * Return the index of the first non-option argument, or -1 if an option is invalid.
+ */
+int parseOptions( int argc, char** argv )
+{
+	static struct option long_options[] =
+	{
+		{ "count", no_argument, NULL, 'c' },
+		{ "top", required_argument, NULL, 'k' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int option;
+	char* end;
+
+	while( ( option = getopt_long( argc, argv, "ck:", long_options, NULL ) ) != -1 )
+	{
+		switch( option )
+		{
+			case 'c':
+				count_only = 1;
+				break;
+
+			case 'k':
+				top = strtoul( optarg, &end, 10 );
+				if( *end != '\0' || top == 0 )
+				{
+					printf("ERROR: --top needs a positive number of files\n");
+					return -1;
+				}
+				break;
+
+			default:
+				return -1;
+		}
+	}
+
+	return optind;
+}
+
+void printUsage()
 {
-	
-	// insert code here...
-	printf("Hello, World!\n");
-    return 0;
-}
\ No newline at end of file
+	printf("USAGE: search [options] <inverted-index file name>\n");
+	printf("Reads one query per line, such as: cat dog OR NOT (bird fish)\n");
+	printf("OPTIONS:\n");
+	printf("  -c, --count                print only how many files match each query\n");
+	printf("  -k, --top=N                rank the files by BM25 and print the best N with their scores\n");
+}
+
+/**
+ * Parse and evaluate one query, and print its result and timing.
+ */
+void runQuery( QueryIndexPtr index, char* query )
+{
+	struct timespec start;
+	struct QueryList result;
+	const char* error = "out of memory";
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+
+	QueryNodePtr node = QEParse( query, &error );
+
+	if( node == NULL )
+	{
+		printf("ERROR: %s\n", error);
+		return;
+	}
+
+	int successful = QEEvaluate( index, node, &result );
+	double milliseconds = elapsedMilliseconds( &start );
+
+	QEFreeNode( node );
+
+	if( !successful )
+	{
+		printf("ERROR: out of memory\n");
+		return;
+	}
+
+	size_t i;
+
+	for( i = 0; i < result.count && !count_only; i++ )
+	{
+		const char* path = QEPath( index, result.ids[i] );
+
+		/* A damaged index can name a file it has no path for. */
+		if( path == NULL )
+		{
+			printf("ERROR: file %" PRIu32 " has no path in the index\n", result.ids[i]);
+			continue;
+		}
+
+		printf("%s\n", path);
+	}
+
+	printf("%zu files in %.3f ms\n", result.count, milliseconds);
+
+	QEFreeList( &result );
+}
+
+/**
+ * Rank the files for one query, and print the best and the timing.
+ */
+void runRankedQuery( QueryIndexPtr index, char* query )
+{
+	struct timespec start;
+	QueryHitPtr hits = malloc( top * sizeof(*hits) );
+	size_t count;
+
+	if( hits == NULL )
+	{
+		printf("ERROR: out of memory\n");
+		return;
+	}
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+
+	int successful = QERank( index, query, top, hits, &count );
+	double milliseconds = elapsedMilliseconds( &start );
+
+	if( !successful )
+	{
+		printf("ERROR: out of memory\n");
+		free( hits );
+		return;
+	}
+
+	size_t i;
+
+	for( i = 0; i < count && !count_only; i++ )
+	{
+		const char* path = QEPath( index, hits[i].file_id );
+
+		if( path == NULL )
+		{
+			printf("ERROR: file %" PRIu32 " has no path in the index\n", hits[i].file_id);
+			continue;
+		}
+
+		printf("%s %.4f\n", path, hits[i].score);
+	}
+
+	printf("%zu files in %.3f ms\n", count, milliseconds);
+
+	free( hits );
+}
+
+int main( int argc, char** argv )
+{
+	int first_argument = parseOptions( argc, argv );
+
+	if( first_argument < 0 || argc - first_argument != 1 )
+	{
+		printUsage();
+		exit( EXIT_FAILURE );
+	}
+
+	struct timespec start;
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+
+	QueryIndexPtr index = QEOpen( argv[first_argument] );
+
+	if( index == NULL )
+	{
+		printf("ERROR: Could not read the index %s\n", argv[first_argument]);
+		exit( EXIT_FAILURE );
+	}
+
+	printf("%zu terms in %zu files, loaded in %.3f ms\n", QETermCount( index ), QEFileCount( index ), elapsedMilliseconds( &start ));
+
+	char* line = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+
+	while( ( length = getline( &line, &capacity, stdin ) ) != -1 )
+	{
+		if( length > 0 && line[length - 1] == '\n' )
+		{
+			line[length - 1] = '\0';
+		}
+
+		if( line[0] != '\0' )
+		{
+			if( top > 0 )
+			{
+				runRankedQuery( index, line );
+			}
+			else
+			{
+				runQuery( index, line );
+			}
+		}
+	}
+
+	free( line );
+	QEClose( index );
+
+	return 0;
+}
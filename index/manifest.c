@@ -0,0 +1,244 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include "manifest.h"
+
+static int readEntry( FILE* file, ManifestEntryPtr entry );
+
+/**
+ * Read one line of a manifest, after its header, into entry, whose path is
+ * allocated here.
+ *
+ * Return 1 if successful, 0 at the end of the file, or -1 if the line is not
+ * a complete entry or memory ran out.
+ */
+static int readEntry( FILE* file, ManifestEntryPtr entry )
+{
+	size_t path_length;
+	int fields = fscanf( file, "%" SCNu64 " %" SCNd64 " %" SCNx64 " %" SCNu64 " %zu", &entry->size, &entry->mtime, &entry->hash, &entry->length, &path_length );
+
+	if( fields == EOF && !ferror( file ) )
+	{
+		return 0;
+	}
+
+	if( fields != 5 || fgetc( file ) != ' ' )
+	{
+		return -1;
+	}
+
+	entry->path = malloc( path_length + 1 );
+
+	if( entry->path == NULL )
+	{
+		return -1;
+	}
+
+	if( fread( entry->path, 1, path_length, file ) != path_length || fgetc( file ) != '\n' )
+	{
+		free( entry->path );
+		return -1;
+	}
+
+	entry->path[path_length] = '\0';
+
+	return 1;
+}
+
+char* ManifestPath( const char* index_path )
+{
+	size_t length = strlen( index_path );
+	char* path = malloc( length + sizeof(MANIFEST_SUFFIX) );
+
+	if( path != NULL )
+	{
+		memcpy( path, index_path, length );
+		memcpy( path + length, MANIFEST_SUFFIX, sizeof(MANIFEST_SUFFIX) );
+	}
+
+	return path;
+}
+
+ManifestPtr ManifestRead( char* file_path )
+{
+	FILE* file = fopen( file_path, "r" );
+
+	if( file == NULL )
+	{
+		return NULL;
+	}
+
+	ManifestPtr manifest = calloc( 1, sizeof(*manifest) );
+	int version;
+	int escapes;
+	int successful = manifest != NULL && fscanf( file, MANIFEST_MAGIC " %d %d", &version, &escapes ) == 2 &&
+		version == MANIFEST_VERSION && fgetc( file ) == '\n';
+	size_t capacity = 0;
+	struct ManifestEntry entry;
+
+	if( successful )
+	{
+		manifest->escapes = (TKEscapeMode)escapes;
+	}
+
+	int read = 0;
+
+	while( successful && ( read = readEntry( file, &entry ) ) > 0 )
+	{
+		/* Entries out of order could not be found again, so the manifest is not to be trusted. */
+		if( manifest->count > 0 && strcmp( manifest->entries[manifest->count - 1].path, entry.path ) >= 0 )
+		{
+			free( entry.path );
+			successful = 0;
+			break;
+		}
+
+		if( manifest->count == capacity )
+		{
+			capacity = capacity > 0 ? capacity * 2 : 64;
+			ManifestEntryPtr entries = realloc( manifest->entries, capacity * sizeof(*entries) );
+
+			if( entries == NULL )
+			{
+				free( entry.path );
+				successful = 0;
+				break;
+			}
+			manifest->entries = entries;
+		}
+
+		manifest->entries[manifest->count++] = entry;
+	}
+
+	if( read < 0 )
+	{
+		successful = 0;
+	}
+
+	fclose( file );
+
+	if( !successful && manifest != NULL )
+	{
+		ManifestDestroy( manifest );
+		return NULL;
+	}
+
+	return manifest;
+}
+
+ManifestEntryPtr ManifestFind( ManifestPtr manifest, const char* path )
+{
+	size_t low = 0;
+	size_t high = manifest->count;
+
+	while( low < high )
+	{
+		size_t middle = low + ( high - low ) / 2;
+		int comparison = strcmp( manifest->entries[middle].path, path );
+
+		if( comparison == 0 )
+		{
+			return &manifest->entries[middle];
+		}
+
+		if( comparison < 0 )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return NULL;
+}
+
+void ManifestDestroy( ManifestPtr manifest )
+{
+	size_t i;
+
+	for( i = 0; i < manifest->count; i++ )
+	{
+		free( manifest->entries[i].path );
+	}
+
+	free( manifest->entries );
+	free( manifest );
+}
+
+ManifestWriterPtr ManifestCreate( char* file_path, TKEscapeMode escapes )
+{
+	ManifestWriterPtr writer = calloc( 1, sizeof(*writer) );
+
+	if( writer == NULL )
+	{
+		return NULL;
+	}
+
+	writer->path = strdup( file_path );
+	writer->temp_path = malloc( strlen( file_path ) + sizeof(".new") );
+
+	if( writer->path == NULL || writer->temp_path == NULL )
+	{
+		free( writer->path );
+		free( writer->temp_path );
+		free( writer );
+		return NULL;
+	}
+
+	sprintf( writer->temp_path, "%s.new", file_path );
+
+	writer->file = fopen( writer->temp_path, "w" );
+
+	if( writer->file == NULL )
+	{
+		free( writer->path );
+		free( writer->temp_path );
+		free( writer );
+		return NULL;
+	}
+
+	fprintf( writer->file, "%s %d %d\n", MANIFEST_MAGIC, MANIFEST_VERSION, (int)escapes );
+
+	return writer;
+}
+
+int ManifestAdd( ManifestWriterPtr writer, ManifestEntryPtr entry )
+{
+	size_t path_length = strlen( entry->path );
+
+	fprintf( writer->file, "%" PRIu64 " %" PRId64 " %016" PRIx64 " %" PRIu64 " %zu ", entry->size, entry->mtime, entry->hash, entry->length, path_length );
+	fwrite( entry->path, 1, path_length, writer->file );
+	fputc( '\n', writer->file );
+
+	return !ferror( writer->file );
+}
+
+int ManifestFinish( ManifestWriterPtr writer )
+{
+	int successful = !ferror( writer->file );
+
+	if( fclose( writer->file ) != 0 )
+	{
+		successful = 0;
+	}
+
+	/* The old manifest is only replaced by a complete one. */
+	if( successful && rename( writer->temp_path, writer->path ) != 0 )
+	{
+		successful = 0;
+	}
+
+	if( !successful )
+	{
+		unlink( writer->temp_path );
+	}
+
+	free( writer->path );
+	free( writer->temp_path );
+	free( writer );
+
+	return successful;
+}
@@ -0,0 +1,120 @@
+#ifndef index_manifest_h
+#define index_manifest_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "tokenizer.h"
+
+/*
+ * manifest.h
+ *
+ * The manifest of an index: what each file indexed into it looked like, so
+ * that an incremental build can tell which files changed since and only
+ * read those again.  It is kept beside the index, at the index's path with
+ * MANIFEST_SUFFIX appended, and is replaced as a whole each time.
+ *
+ * The manifest is text.  The first line is MANIFEST_MAGIC, the version and
+ * the escape mode the files were tokenized with.  Every other line describes
+ * one file, in ascending strcmp order of path: its size in bytes, its
+ * modification time in nanoseconds, the HashBytes hash of its contents in
+ * hex, its number of tokens, and the length of its path followed by a space
+ * and the path itself, so that a path may hold any byte.
+ */
+
+#define MANIFEST_MAGIC "IDXMANIFEST"
+#define MANIFEST_VERSION 2
+
+/* Appended to an index's path to name its manifest. */
+#define MANIFEST_SUFFIX ".manifest"
+
+/*
+ * One file of a manifest.
+ */
+struct ManifestEntry
+{
+	char* path;
+	uint64_t size;
+	int64_t mtime;
+	uint64_t hash;
+
+	/* The number of tokens in the file, which is its length for ranking. */
+	uint64_t length;
+};
+typedef struct ManifestEntry* ManifestEntryPtr;
+
+/*
+ * A manifest as read from a file, its entries in ascending order of path.
+ */
+struct Manifest
+{
+	/* The escape mode the files were tokenized with. */
+	TKEscapeMode escapes;
+
+	ManifestEntryPtr entries;
+	size_t count;
+};
+typedef struct Manifest* ManifestPtr;
+
+struct ManifestWriter
+{
+	FILE* file;
+
+	/* The manifest is written here, and renamed over the old one once it is complete. */
+	char* path;
+	char* temp_path;
+};
+typedef struct ManifestWriter* ManifestWriterPtr;
+
+/*
+ * ManifestPath returns the path of the manifest of the index at index_path,
+ * in a new string that the caller frees, or NULL if memory ran out.
+ */
+char* ManifestPath( const char* index_path );
+
+/*
+ * ManifestRead reads the manifest at file_path.
+ *
+ * If the file exists and is a complete manifest, it returns a non-NULL
+ * ManifestPtr.  Else it returns NULL.
+ */
+ManifestPtr ManifestRead( char* file_path );
+
+/*
+ * ManifestFind returns the entry of manifest for path, or NULL if it has
+ * none.
+ */
+ManifestEntryPtr ManifestFind( ManifestPtr manifest, const char* path );
+
+/*
+ * ManifestDestroy destroys a manifest read by ManifestRead.
+ */
+void ManifestDestroy( ManifestPtr manifest );
+
+/*
+ * ManifestCreate starts a new manifest, to replace any at file_path once it
+ * is finished, for files tokenized with the given escape mode.
+ *
+ * If the function succeeds, it returns a non-NULL ManifestWriterPtr.
+ * Else it returns NULL.
+ */
+ManifestWriterPtr ManifestCreate( char* file_path, TKEscapeMode escapes );
+
+/*
+ * ManifestAdd appends entry to the manifest.  Entries must be added in
+ * ascending strcmp order of path.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int ManifestAdd( ManifestWriterPtr writer, ManifestEntryPtr entry );
+
+/*
+ * ManifestFinish puts the manifest in place of any old one, unless writing
+ * it failed, and destroys the writer.
+ *
+ * If the manifest was written and put in place, it returns 1.  Else, it
+ * returns 0, and the old manifest is left as it was.
+ */
+int ManifestFinish( ManifestWriterPtr writer );
+
+#endif
@@ -0,0 +1,376 @@
+#include <stdlib.h>
+#include <string.h>
+#include "postings.h"
+
+static size_t blockCapacity( PostingBlockPtr block );
+static int comesBefore( PostingPtr a, PostingPtr b );
+static size_t encode( unsigned char* out, int64_t delta, size_t appearances );
+static void insertionSort( PostingPtr items, size_t count );
+static int radixPass( PostingPtr src, PostingPtr dst, size_t count, int by_appearances, size_t max_appearances, int shift );
+static uint64_t readVarint( const unsigned char** p );
+static void seal( PostingListPtr list );
+static size_t writeVarint( unsigned char* out, uint64_t value );
+
+/**
+ * Return the number of bytes of postings that block has room for.
+ */
+static size_t blockCapacity( PostingBlockPtr block )
+{
+	return ( (size_t)1 << block->size_class ) - offsetof( struct PostingBlock, bytes );
+}
+
+/**
+ * Return 1 if posting a belongs before posting b in output order, 0 otherwise.
+ */
+static int comesBefore( PostingPtr a, PostingPtr b )
+{
+	if( a->appearances != b->appearances )
+	{
+		return a->appearances > b->appearances;
+	}
+
+	return a->file_id < b->file_id;
+}
+
+/**
+ * Encode one posting into out: the zigzag-encoded delta, so that a small
+ * step backwards is as short as a small step forwards, then the appearances.
+ *
+ * Return the number of bytes written, at most PL_MAX_ENCODED.
+ */
+static size_t encode( unsigned char* out, int64_t delta, size_t appearances )
+{
+	uint64_t zigzag = ( (uint64_t)delta << 1 ) ^ (uint64_t)( delta >> 63 );
+	size_t length = writeVarint( out, zigzag );
+
+	return length + writeVarint( out + length, appearances );
+}
+
+static void insertionSort( PostingPtr items, size_t count )
+{
+	size_t i;
+
+	for( i = 1; i < count; i++ )
+	{
+		struct Posting p = items[i];
+		size_t j = i;
+
+		while( j > 0 && comesBefore( &p, &items[j - 1] ) )
+		{
+			items[j] = items[j - 1];
+			j--;
+		}
+
+		items[j] = p;
+	}
+}
+
+/**
+ * One stable counting-sort pass of an LSD radix sort, on the byte of the key
+ * at the given shift.  The key is either the file ID or, so that a larger
+ * count sorts first, max_appearances minus the appearances.
+ *
+ * Return 1 if src was distributed into dst, or 0 if every posting has the
+ * same byte, in which case the pass is skipped and src is left as it is.
+ */
+static int radixPass( PostingPtr src, PostingPtr dst, size_t count, int by_appearances, size_t max_appearances, int shift )
+{
+	size_t offsets[256];
+	size_t i;
+
+	memset( offsets, 0, sizeof(offsets) );
+
+	for( i = 0; i < count; i++ )
+	{
+		size_t key = by_appearances ? max_appearances - src[i].appearances : src[i].file_id;
+		offsets[( key >> shift ) & 0xFF]++;
+	}
+
+	size_t total = 0;
+
+	for( i = 0; i < 256; i++ )
+	{
+		if( offsets[i] == count )
+		{
+			return 0;
+		}
+
+		size_t bucket = offsets[i];
+		offsets[i] = total;
+		total += bucket;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		size_t key = by_appearances ? max_appearances - src[i].appearances : src[i].file_id;
+		dst[offsets[( key >> shift ) & 0xFF]++] = src[i];
+	}
+
+	return 1;
+}
+
+/**
+ * Read a varint at *p, advancing *p past it.
+ */
+static uint64_t readVarint( const unsigned char** p )
+{
+	const unsigned char* q = *p;
+	uint64_t value = *q & 0x7F;
+	int shift = 7;
+
+	while( *q++ & 0x80 )
+	{
+		value |= (uint64_t)( *q & 0x7F ) << shift;
+		shift += 7;
+	}
+
+	*p = q;
+
+	return value;
+}
+
+/**
+ * Mark the end of the list's last block, if it has room left, before another
+ * block is linked after it.
+ */
+static void seal( PostingListPtr list )
+{
+	if( list->last != NULL && list->used < blockCapacity( list->last ) )
+	{
+		list->last->bytes[list->used] = 0;
+	}
+}
+
+/**
+ * Write value to out as a varint.
+ *
+ * Return the number of bytes written.
+ */
+static size_t writeVarint( unsigned char* out, uint64_t value )
+{
+	size_t length = 0;
+
+	while( value >= 0x80 )
+	{
+		out[length++] = (unsigned char)( value | 0x80 );
+		value >>= 7;
+	}
+
+	out[length++] = (unsigned char)value;
+
+	return length;
+}
+
+void PLInit( PostingListPtr list )
+{
+	list->first = NULL;
+	list->last = NULL;
+	list->count = 0;
+	list->last_file_id = 0;
+	list->used = 0;
+}
+
+int PLAppend( PostingListPtr list, ArenaPtr arena, uint32_t file_id, size_t appearances )
+{
+	unsigned char encoded[PL_MAX_ENCODED];
+	size_t length;
+
+	if( list->last != NULL )
+	{
+		length = encode( encoded, (int64_t)file_id - list->last_file_id, appearances );
+
+		if( length <= blockCapacity( list->last ) - list->used )
+		{
+			memcpy( list->last->bytes + list->used, encoded, length );
+			list->used += length;
+			list->last_file_id = file_id;
+			list->count++;
+			return 1;
+		}
+	}
+
+	/* A block's first delta is from -1 rather than 0, so that no posting starts with a 0 byte. */
+	length = encode( encoded, (int64_t)file_id + 1, appearances );
+
+	int size_class = list->last != NULL ? list->last->size_class + 1 : PL_MIN_BLOCK_CLASS;
+
+	if( size_class > PL_MAX_BLOCK_CLASS )
+	{
+		size_class = PL_MAX_BLOCK_CLASS;
+	}
+
+	while( ( (size_t)1 << size_class ) - offsetof( struct PostingBlock, bytes ) < length )
+	{
+		size_class++;
+	}
+
+	PostingBlockPtr block = ArenaPoolAlloc( arena, (size_t)1 << size_class );
+
+	if( block == NULL )
+	{
+		return 0;
+	}
+
+	block->next = NULL;
+	block->size_class = size_class;
+	memcpy( block->bytes, encoded, length );
+
+	if( list->last != NULL )
+	{
+		seal( list );
+		list->last->next = block;
+	}
+	else
+	{
+		list->first = block;
+	}
+
+	list->last = block;
+	list->used = length;
+	list->last_file_id = file_id;
+	list->count++;
+
+	return 1;
+}
+
+void PLAppendAll( PostingListPtr dest, PostingListPtr src )
+{
+	if( src->first == NULL )
+	{
+		return;
+	}
+
+	if( dest->last == NULL )
+	{
+		*dest = *src;
+	}
+	else
+	{
+		seal( dest );
+		dest->last->next = src->first;
+		dest->last = src->last;
+		dest->count += src->count;
+		dest->last_file_id = src->last_file_id;
+		dest->used = src->used;
+	}
+
+	PLInit( src );
+}
+
+void PLDecode( PostingListPtr list, PostingPtr items )
+{
+	PostingBlockPtr block;
+	size_t n = 0;
+
+	for( block = list->first; block != NULL; block = block->next )
+	{
+		const unsigned char* p = block->bytes;
+		const unsigned char* end = p + ( block == list->last ? list->used : blockCapacity( block ) );
+		int64_t file_id = -1;
+
+		while( p < end && *p != 0 )
+		{
+			uint64_t zigzag = readVarint( &p );
+
+			file_id += (int64_t)( zigzag >> 1 ) ^ -(int64_t)( zigzag & 1 );
+			items[n].file_id = file_id;
+			items[n].appearances = readVarint( &p );
+			n++;
+		}
+	}
+}
+
+void PLSort( PostingPtr items, size_t count )
+{
+	if( count < PL_INSERTION_SORT_MAX )
+	{
+		insertionSort( items, count );
+		return;
+	}
+
+	PostingPtr scratch = malloc( count * sizeof(*scratch) );
+
+	if( scratch == NULL )
+	{
+		insertionSort( items, count );
+		return;
+	}
+
+	/* Find how many bytes each key spans, and whether the IDs are already in order. */
+	uint32_t max_id = 0;
+	size_t max_appearances = 0;
+	size_t min_appearances = (size_t)-1;
+	int ids_sorted = 1;
+	size_t i;
+
+	for( i = 0; i < count; i++ )
+	{
+		if( items[i].file_id > max_id )
+		{
+			max_id = items[i].file_id;
+		}
+		if( items[i].appearances > max_appearances )
+		{
+			max_appearances = items[i].appearances;
+		}
+		if( items[i].appearances < min_appearances )
+		{
+			min_appearances = items[i].appearances;
+		}
+		if( i > 0 && items[i].file_id < items[i - 1].file_id )
+		{
+			ids_sorted = 0;
+		}
+	}
+
+	/*
+	 * Sort by the minor key, the file ID, first, then by the major key; each
+	 * pass is stable, so ties on appearances stay in ID order.  A single-threaded
+	 * build decodes postings in ID order, which makes the first passes free.
+	 */
+	PostingPtr src = items;
+	PostingPtr dst = scratch;
+	size_t range = max_appearances - min_appearances;
+	int shift;
+
+	for( shift = 0; !ids_sorted && shift < 32 && ( max_id >> shift ) != 0; shift += 8 )
+	{
+		if( radixPass( src, dst, count, 0, 0, shift ) )
+		{
+			PostingPtr tmp = src;
+			src = dst;
+			dst = tmp;
+		}
+	}
+
+	for( shift = 0; shift < (int)( sizeof(size_t) * 8 ) && ( range >> shift ) != 0; shift += 8 )
+	{
+		if( radixPass( src, dst, count, 1, max_appearances, shift ) )
+		{
+			PostingPtr tmp = src;
+			src = dst;
+			dst = tmp;
+		}
+	}
+
+	if( src != items )
+	{
+		memcpy( items, src, count * sizeof(*items) );
+	}
+
+	free( scratch );
+}
+
+void PLDestroy( PostingListPtr list, ArenaPtr arena )
+{
+	PostingBlockPtr block = list->first;
+
+	while( block != NULL )
+	{
+		PostingBlockPtr next = block->next;
+		ArenaPoolFree( arena, block, (size_t)1 << block->size_class );
+		block = next;
+	}
+
+	PLInit( list );
+}
@@ -0,0 +1,112 @@
+#ifndef index_postings_h
+#define index_postings_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+/*
+ * postings.h
+ *
+ * A term's postings: the files it appears in, with the number of appearances
+ * in each.  While the index is built, postings are appended in whatever
+ * order the files are read, compressed: each is the difference from the
+ * previous file ID, zigzag-encoded since files are not always read in ID
+ * order, followed by the appearances, both as varints (7 bits a byte, the
+ * high bit set on all but the last byte).  A posting typically takes 2 to 4
+ * bytes rather than 16.
+ *
+ * The bytes go into a chain of blocks from the pool of the index's arena,
+ * each block twice the size of the one before, up to PL_MAX_BLOCK_CLASS.
+ * Every block starts its deltas afresh, so the chains of two lists can be
+ * joined without re-encoding.  Postings are only decoded, by PLDecode, and
+ * put in output order, by PLSort, when the index is written.
+ */
+
+/* Lists shorter than this are sorted by insertion rather than by radix sort. */
+#define PL_INSERTION_SORT_MAX 32
+
+/* Blocks are 2^PL_MIN_BLOCK_CLASS to 2^PL_MAX_BLOCK_CLASS bytes, header included. */
+#define PL_MIN_BLOCK_CLASS 4
+#define PL_MAX_BLOCK_CLASS 12
+
+/* The most bytes one encoded posting can take: a 33-bit delta and a 64-bit count. */
+#define PL_MAX_ENCODED 15
+
+/*
+ * One decoded posting.  The file is identified by its position in the index's file table.
+ */
+struct Posting
+{
+	uint32_t file_id;
+	size_t appearances;
+};
+typedef struct Posting* PostingPtr;
+
+/*
+ * A block of encoded postings.  A block that is not the last of its list
+ * ends at its size or at a 0 byte, which no posting starts with.
+ */
+struct PostingBlock
+{
+	struct PostingBlock* next;
+
+	/* The block is 2^size_class bytes, header included. */
+	uint8_t size_class;
+	unsigned char bytes[];
+};
+typedef struct PostingBlock* PostingBlockPtr;
+
+struct PostingList
+{
+	PostingBlockPtr first;
+	PostingBlockPtr last;
+
+	/* The number of postings in the list. */
+	uint32_t count;
+
+	/* The file ID of the last posting, and the number of bytes used in the last block. */
+	uint32_t last_file_id;
+	uint32_t used;
+};
+typedef struct PostingList* PostingListPtr;
+
+/*
+ * PLInit makes list an empty list.
+ */
+void PLInit( PostingListPtr list );
+
+/*
+ * PLAppend adds a posting for file_id, with the given appearances, to the end
+ * of list, growing it from arena if needed.  The file must not already be in
+ * the list.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int PLAppend( PostingListPtr list, ArenaPtr arena, uint32_t file_id, size_t appearances );
+
+/*
+ * PLAppendAll moves every posting of src to the end of dest, leaving src
+ * empty.  The blocks are linked rather than copied, so this cannot fail.  No
+ * file may be in both lists.
+ */
+void PLAppendAll( PostingListPtr dest, PostingListPtr src );
+
+/*
+ * PLDecode writes the list's postings, in the order they were appended, to
+ * items, which must have room for list->count of them.
+ */
+void PLDecode( PostingListPtr list, PostingPtr items );
+
+/*
+ * PLSort puts count decoded postings in output order: by descending
+ * appearances, and by ascending file ID among postings with equal appearances.
+ */
+void PLSort( PostingPtr items, size_t count );
+
+/*
+ * PLDestroy returns the list's blocks to the pool of arena, leaving it empty.
+ */
+void PLDestroy( PostingListPtr list, ArenaPtr arena );
+
+#endif
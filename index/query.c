@@ -0,0 +1,1985 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "query.h"
+#include "bm25.h"
+#include "hash.h"
+#include "hash-table.h"
+
+/* The file ID of a ranking cursor that has run out of postings. */
+#define NO_FILE UINT32_MAX
+
+typedef enum
+{
+	TOKEN_END,
+	TOKEN_WORD,
+	TOKEN_AND,
+	TOKEN_OR,
+	TOKEN_NOT,
+	TOKEN_OPEN,
+	TOKEN_CLOSE
+} QueryToken;
+
+/*
+ * The state of QEParse: the rest of the query, and the token just read.
+ */
+struct QueryParser
+{
+	const char* position;
+	QueryToken token;
+	const char* word;
+	size_t word_length;
+
+	/* Why the query could not be parsed; NULL if memory ran out. */
+	const char* error;
+};
+
+/* How combine merges two lists. */
+typedef enum
+{
+	COMBINE_OR,
+	COMBINE_AND_NOT
+} CombineOp;
+
+/*
+ * One term of a ranked query, read a posting at a time.  Blocks are decoded
+ * only once a posting in them is needed; until then, their last file ID
+ * and greatest weight say what they could hold.
+ */
+struct RankCursor
+{
+	/* For a binary index: the term's postings, and the block decoded into ids and appearances. */
+	struct BICursor postings;
+	size_t decoded;
+	uint32_t ids[BI_BLOCK_SIZE];
+	size_t appearances[BI_BLOCK_SIZE];
+
+	/* For a text index: the term's postings, and its blocks' greatest weights. */
+	const uint32_t* all_ids;
+	const size_t* all_appearances;
+	const float* block_max;
+
+	size_t count;
+	size_t block_size;
+	size_t block_count;
+
+	/* The current posting and its file, NO_FILE once the postings run out. */
+	size_t position;
+	uint32_t file_id;
+
+	/* The block last looked at for file IDs ahead of the current posting. */
+	size_t shallow;
+
+	double idf;
+	double max_weight;
+};
+
+/*
+ * An operand of an AND, and how many files it is expected to match.
+ */
+struct Operand
+{
+	QueryNodePtr node;
+	size_t estimate;
+};
+
+/*
+ * A file of a text index, and the ID it was given when it first appeared.
+ */
+struct NumberedPath
+{
+	char* path;
+	uint32_t id;
+};
+
+static int addChild( QueryNodePtr node, QueryNodePtr child );
+static int betterHit( struct QueryHit* a, struct QueryHit* b );
+static int combine( QueryListPtr a, QueryListPtr b, CombineOp op );
+static int compareFileIDs( const void* a, const void* b );
+static int comparePaths( const void* a, const void* b );
+static int complement( QueryIndexPtr index, QueryListPtr list );
+static uint32_t cursorBlockLast( struct RankCursor* cursor, size_t block );
+static double cursorBlockMax( struct RankCursor* cursor, size_t block );
+static int cursorSeek( struct RankCursor* cursor, uint64_t target );
+static size_t cursorShallow( struct RankCursor* cursor, uint32_t target );
+static size_t estimate( QueryIndexPtr index, QueryNodePtr node );
+static int evaluateAnd( QueryIndexPtr index, QueryNodePtr node, QueryListPtr result );
+static int findTerm( QueryIndexPtr index, const char* term, size_t length, size_t* position );
+static int intersect( QueryListPtr a, QueryListPtr b );
+static size_t intersectGallop( const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out );
+static size_t intersectMerge( const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out );
+static size_t intersectSorted( const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out );
+static int intersectTerm( QueryIndexPtr index, size_t position, QueryListPtr list );
+static int loadText( QueryIndexPtr index );
+static QueryNodePtr newNode( QueryOp op );
+static void nextToken( struct QueryParser* parser );
+static int numberFiles( QueryIndexPtr index, PostingPtr postings );
+static int openCursor( QueryIndexPtr index, size_t position, struct RankCursor* cursor );
+static QueryNodePtr parseAnd( struct QueryParser* parser );
+static QueryNodePtr parseOr( struct QueryParser* parser );
+static QueryNodePtr parseUnary( struct QueryParser* parser );
+static const char* readWord( const char** p, const char* end, size_t* length );
+static void siftDown( struct QueryHit* heap, size_t count, size_t node );
+static int weighText( QueryIndexPtr index );
+
+/**
+ * Append child to the children of node.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int addChild( QueryNodePtr node, QueryNodePtr child )
+{
+	QueryNodePtr* children = realloc( node->children, ( node->child_count + 1 ) * sizeof(*children) );
+
+	if( children == NULL )
+	{
+		return 0;
+	}
+
+	node->children = children;
+	node->children[node->child_count++] = child;
+
+	return 1;
+}
+
+/**
+ * Return 1 if hit a ranks above hit b: it scores more, or the same with a
+ * lower file ID.  0 otherwise.
+ */
+static int betterHit( struct QueryHit* a, struct QueryHit* b )
+{
+	return a->score > b->score || ( a->score == b->score && a->file_id < b->file_id );
+}
+
+/**
+ * Merge list b into list a: keep the files in either, or in a but not b.
+ * b is freed, and so is a if memory runs out.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int combine( QueryListPtr a, QueryListPtr b, CombineOp op )
+{
+	size_t capacity = op == COMBINE_OR ? a->count + b->count : a->count;
+	uint32_t* ids = malloc( ( capacity > 0 ? capacity : 1 ) * sizeof(*ids) );
+
+	if( ids == NULL )
+	{
+		QEFreeList( a );
+		QEFreeList( b );
+		return 0;
+	}
+
+	size_t i = 0;
+	size_t j = 0;
+	size_t count = 0;
+
+	while( i < a->count && j < b->count )
+	{
+		uint32_t x = a->ids[i];
+		uint32_t y = b->ids[j];
+
+		if( x <= y )
+		{
+			if( op == COMBINE_OR || x < y )
+			{
+				ids[count++] = x;
+			}
+			i++;
+			j += x == y;
+		}
+		else
+		{
+			if( op == COMBINE_OR )
+			{
+				ids[count++] = y;
+			}
+			j++;
+		}
+	}
+
+	if( i < a->count )
+	{
+		memcpy( ids + count, a->ids + i, ( a->count - i ) * sizeof(*ids) );
+		count += a->count - i;
+	}
+
+	if( op == COMBINE_OR && j < b->count )
+	{
+		memcpy( ids + count, b->ids + j, ( b->count - j ) * sizeof(*ids) );
+		count += b->count - j;
+	}
+
+	QEFreeList( a );
+	QEFreeList( b );
+	a->ids = ids;
+	a->count = count;
+	a->owned = 1;
+
+	return 1;
+}
+
+/**
+ * Order two postings by ascending file ID, for qsort.
+ */
+static int compareFileIDs( const void* a, const void* b )
+{
+	uint32_t x = ( (const struct Posting*)a )->file_id;
+	uint32_t y = ( (const struct Posting*)b )->file_id;
+
+	return ( x > y ) - ( x < y );
+}
+
+/**
+ * Order two numbered paths by ascending strcmp of path, for qsort.
+ */
+static int comparePaths( const void* a, const void* b )
+{
+	return strcmp( ( (const struct NumberedPath*)a )->path, ( (const struct NumberedPath*)b )->path );
+}
+
+/**
+ * Replace list with the files of the index that are not in it.  Files with
+ * no tokens are left out, as a text index cannot know of them, so that both
+ * formats give the same answer.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int complement( QueryIndexPtr index, QueryListPtr list )
+{
+	size_t file_count = QEFileCount( index );
+	uint32_t* ids = malloc( ( file_count > 0 ? file_count : 1 ) * sizeof(*ids) );
+
+	if( ids == NULL )
+	{
+		return 0;
+	}
+
+	size_t i = 0;
+	size_t count = 0;
+	uint32_t id;
+
+	for( id = 0; id < file_count; id++ )
+	{
+		if( i < list->count && list->ids[i] == id )
+		{
+			i++;
+			continue;
+		}
+
+		if( index->binary != NULL && BILength( index->binary, id ) == 0 )
+		{
+			continue;
+		}
+
+		ids[count++] = id;
+	}
+
+	QEFreeList( list );
+	list->ids = ids;
+	list->count = count;
+	list->owned = 1;
+
+	return 1;
+}
+
+/**
+ * Return the last file ID in the given block of cursor's postings, or
+ * UINT32_MAX if it is not known without decoding the block.
+ */
+static uint32_t cursorBlockLast( struct RankCursor* cursor, size_t block )
+{
+	if( cursor->all_ids == NULL )
+	{
+		return BIBlockLast( &cursor->postings, block );
+	}
+
+	size_t end = ( block + 1 ) * cursor->block_size;
+
+	return cursor->all_ids[( end < cursor->count ? end : cursor->count ) - 1];
+}
+
+/**
+ * Return the term's greatest weight in the given block of cursor's postings.
+ */
+static double cursorBlockMax( struct RankCursor* cursor, size_t block )
+{
+	if( cursor->all_ids == NULL )
+	{
+		return BIBlockMax( &cursor->postings, block );
+	}
+
+	return cursor->block_max[block];
+}
+
+/**
+ * Move cursor on to its first posting for a file ID of at least target,
+ * skipping blocks that end before it without decoding them.  A cursor is
+ * never moved back.
+ *
+ * Return 1 if successful, 0 if a block could not be decoded.
+ */
+static int cursorSeek( struct RankCursor* cursor, uint64_t target )
+{
+	size_t block = cursor->position / cursor->block_size;
+
+	while( block < cursor->block_count && ( target > NO_FILE || cursorBlockLast( cursor, block ) < target ) )
+	{
+		block++;
+	}
+
+	for( ; block < cursor->block_count; block++ )
+	{
+		size_t start = block * cursor->block_size;
+		size_t end = start + cursor->block_size < cursor->count ? start + cursor->block_size : cursor->count;
+		const uint32_t* ids = cursor->all_ids;
+
+		if( ids != NULL )
+		{
+			ids += start;
+		}
+		else
+		{
+			if( cursor->decoded != block )
+			{
+				if( BIDecodeBlock( &cursor->postings, block, cursor->ids, cursor->appearances ) != end - start )
+				{
+					return 0;
+				}
+				cursor->decoded = block;
+			}
+			ids = cursor->ids;
+		}
+
+		if( cursor->position < start )
+		{
+			cursor->position = start;
+		}
+
+		while( cursor->position < end && ids[cursor->position - start] < target )
+		{
+			cursor->position++;
+		}
+
+		if( cursor->position < end )
+		{
+			cursor->file_id = ids[cursor->position - start];
+			return 1;
+		}
+	}
+
+	cursor->position = cursor->count;
+	cursor->file_id = NO_FILE;
+
+	return 1;
+}
+
+/**
+ * Return the block of cursor's postings that would hold target, the first
+ * from the current one whose last file ID is at least target, or
+ * block_count if there is none.  No block is decoded.
+ */
+static size_t cursorShallow( struct RankCursor* cursor, uint32_t target )
+{
+	size_t block = cursor->position / cursor->block_size;
+
+	if( cursor->shallow > block )
+	{
+		block = cursor->shallow;
+	}
+
+	while( block < cursor->block_count && cursorBlockLast( cursor, block ) < target )
+	{
+		block++;
+	}
+
+	cursor->shallow = block;
+
+	return block;
+}
+
+/**
+ * Return about how many files node matches, without evaluating it: a term's
+ * document frequency, the fewest of an AND's operands, and the sum of an
+ * OR's.
+ */
+static size_t estimate( QueryIndexPtr index, QueryNodePtr node )
+{
+	size_t file_count = QEFileCount( index );
+	size_t result = 0;
+	size_t position;
+	size_t c;
+
+	switch( node->op )
+	{
+		case QUERY_TERM:
+			if( !findTerm( index, node->term, node->term_length, &position ) )
+			{
+				return 0;
+			}
+
+			return index->binary != NULL ? BITerm( index->binary, position ).posting_count : index->terms[position].count;
+
+		case QUERY_NOT:
+			result = estimate( index, node->children[0] );
+			return result < file_count ? file_count - result : 0;
+
+		case QUERY_AND:
+			result = file_count;
+
+			for( c = 0; c < node->child_count; c++ )
+			{
+				size_t child = estimate( index, node->children[c] );
+
+				if( node->children[c]->op != QUERY_NOT && child < result )
+				{
+					result = child;
+				}
+			}
+			return result;
+
+		case QUERY_OR:
+			for( c = 0; c < node->child_count; c++ )
+			{
+				result += estimate( index, node->children[c] );
+			}
+			return result < file_count ? result : file_count;
+	}
+
+	return file_count;
+}
+
+/**
+ * Evaluate an AND node: intersect the children that are not NOT nodes, from
+ * the one expected to match the fewest files up, then take away the
+ * operands of those that are, so that "a NOT b" never builds the complement
+ * of b.  If every child is a NOT node, they are taken away from every file.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int evaluateAnd( QueryIndexPtr index, QueryNodePtr node, QueryListPtr result )
+{
+	struct Operand* operands = malloc( node->child_count * sizeof(*operands) );
+	struct QueryList child;
+	size_t operand_count = 0;
+	size_t c;
+
+	memset( result, 0, sizeof(*result) );
+
+	if( operands == NULL )
+	{
+		return 0;
+	}
+
+	/* An insertion sort, as queries are short; equal estimates keep the query's order. */
+	for( c = 0; c < node->child_count; c++ )
+	{
+		if( node->children[c]->op == QUERY_NOT )
+		{
+			continue;
+		}
+
+		struct Operand operand = { node->children[c], estimate( index, node->children[c] ) };
+		size_t o = operand_count++;
+
+		while( o > 0 && operands[o - 1].estimate > operand.estimate )
+		{
+			operands[o] = operands[o - 1];
+			o--;
+		}
+
+		operands[o] = operand;
+	}
+
+	int successful = 1;
+
+	for( c = 0; c < operand_count && successful; c++ )
+	{
+		QueryNodePtr operand = operands[c].node;
+		size_t position;
+
+		if( c == 0 )
+		{
+			successful = QEEvaluate( index, operand, result );
+		}
+		else if( result->count == 0 )
+		{
+			break;
+		}
+		else if( operand->op == QUERY_TERM && index->binary != NULL )
+		{
+			/* A term not in the index was estimated at 0 files, so it came first and emptied the result. */
+			successful = findTerm( index, operand->term, operand->term_length, &position ) &&
+				intersectTerm( index, position, result );
+		}
+		else
+		{
+			successful = QEEvaluate( index, operand, &child ) && intersect( result, &child );
+		}
+	}
+
+	free( operands );
+
+	if( !successful )
+	{
+		QEFreeList( result );
+		return 0;
+	}
+
+	if( operand_count == 0 && !complement( index, result ) )
+	{
+		return 0;
+	}
+
+	for( c = 0; c < node->child_count && result->count > 0; c++ )
+	{
+		if( node->children[c]->op != QUERY_NOT )
+		{
+			continue;
+		}
+
+		if( !QEEvaluate( index, node->children[c]->children[0], &child ) )
+		{
+			QEFreeList( result );
+			return 0;
+		}
+
+		if( !combine( result, &child, COMBINE_AND_NOT ) )
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Look up the length bytes at term in the index's dictionary, and store its
+ * position there in *position.
+ *
+ * Return 1 if the term is in the index, 0 otherwise.
+ */
+static int findTerm( QueryIndexPtr index, const char* term, size_t length, size_t* position )
+{
+	if( index->binary != NULL )
+	{
+		*position = BIFind( index->binary, term, length );
+		return *position != BI_NOT_FOUND;
+	}
+
+	/* The terms are in descending order. */
+	size_t low = 0;
+	size_t high = index->term_count;
+
+	while( low < high )
+	{
+		size_t middle = low + ( high - low ) / 2;
+		struct QueryTerm* t = &index->terms[middle];
+		size_t shorter = t->term_length < length ? t->term_length : length;
+		int order = memcmp( t->term, term, shorter );
+
+		if( order == 0 )
+		{
+			order = ( t->term_length > length ) - ( t->term_length < length );
+		}
+
+		if( order == 0 )
+		{
+			*position = middle;
+			return 1;
+		}
+
+		if( order > 0 )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Keep only the files of list a that are also in list b.  b is freed, and
+ * so is a if memory runs out.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int intersect( QueryListPtr a, QueryListPtr b )
+{
+	size_t capacity = a->count < b->count ? a->count : b->count;
+	uint32_t* ids = malloc( ( capacity > 0 ? capacity : 1 ) * sizeof(*ids) );
+
+	if( ids == NULL )
+	{
+		QEFreeList( a );
+		QEFreeList( b );
+		return 0;
+	}
+
+	size_t count = intersectSorted( a->ids, a->count, b->ids, b->count, ids );
+
+	QEFreeList( a );
+	QEFreeList( b );
+	a->ids = ids;
+	a->count = count;
+	a->owned = 1;
+
+	return 1;
+}
+
+/**
+ * Write the IDs in both a and b to out, looking each of a's up in b, which
+ * should be much longer, by doubling the step from the last one found and
+ * then bisecting.
+ *
+ * Return the number of IDs written.
+ */
+static size_t intersectGallop( const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out )
+{
+	size_t count = 0;
+	size_t j = 0;
+	size_t i;
+
+	for( i = 0; i < a_count && j < b_count; i++ )
+	{
+		uint32_t id = a[i];
+
+		if( b[j] < id )
+		{
+			size_t step = 1;
+
+			while( j + step < b_count && b[j + step] < id )
+			{
+				step *= 2;
+			}
+
+			/* b[j + step / 2] < id, and the first ID at least id is no further than j + step. */
+			size_t low = j + step / 2 + 1;
+			size_t high = j + step < b_count ? j + step : b_count;
+
+			while( low < high )
+			{
+				size_t middle = low + ( high - low ) / 2;
+
+				if( b[middle] < id )
+				{
+					low = middle + 1;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+
+			j = low;
+		}
+
+		if( j < b_count && b[j] == id )
+		{
+			out[count++] = id;
+			j++;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Write the IDs in both a and b to out, walking the two lists together.
+ * With SSE2, four IDs of each are compared at once, against b's four
+ * rotated a lane at a time, and the block with the smaller last ID moves on.
+ *
+ * Return the number of IDs written.
+ */
+static size_t intersectMerge( const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out )
+{
+	size_t count = 0;
+	size_t i = 0;
+	size_t j = 0;
+
+#ifdef __SSE2__
+	while( i + 4 <= a_count && j + 4 <= b_count )
+	{
+		__m128i x = _mm_loadu_si128( (const __m128i*)( a + i ) );
+		__m128i y = _mm_loadu_si128( (const __m128i*)( b + j ) );
+		__m128i equal = _mm_or_si128(
+			_mm_or_si128( _mm_cmpeq_epi32( x, y ), _mm_cmpeq_epi32( x, _mm_shuffle_epi32( y, _MM_SHUFFLE( 0, 3, 2, 1 ) ) ) ),
+			_mm_or_si128( _mm_cmpeq_epi32( x, _mm_shuffle_epi32( y, _MM_SHUFFLE( 1, 0, 3, 2 ) ) ),
+				_mm_cmpeq_epi32( x, _mm_shuffle_epi32( y, _MM_SHUFFLE( 2, 1, 0, 3 ) ) ) ) );
+		unsigned int mask = (unsigned int)_mm_movemask_ps( _mm_castsi128_ps( equal ) );
+
+		while( mask != 0 )
+		{
+			out[count++] = a[i + __builtin_ctz( mask )];
+			mask &= mask - 1;
+		}
+
+		uint32_t a_last = a[i + 3];
+		uint32_t b_last = b[j + 3];
+
+		i += a_last <= b_last ? 4 : 0;
+		j += b_last <= a_last ? 4 : 0;
+	}
+#endif
+
+	while( i < a_count && j < b_count )
+	{
+		if( a[i] == b[j] )
+		{
+			out[count++] = a[i];
+			i++;
+			j++;
+		}
+		else if( a[i] < b[j] )
+		{
+			i++;
+		}
+		else
+		{
+			j++;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Write the IDs in both a and b to out, galloping through the longer list
+ * if it is at least QE_GALLOP_RATIO times the shorter one, merging
+ * otherwise.
+ *
+ * Return the number of IDs written.
+ */
+static size_t intersectSorted( const uint32_t* a, size_t a_count, const uint32_t* b, size_t b_count, uint32_t* out )
+{
+	if( a_count > b_count )
+	{
+		return intersectSorted( b, b_count, a, a_count, out );
+	}
+
+	if( a_count * QE_GALLOP_RATIO <= b_count )
+	{
+		return intersectGallop( a, a_count, b, b_count, out );
+	}
+
+	return intersectMerge( a, a_count, b, b_count, out );
+}
+
+/**
+ * Keep only the files of list that contain the term at the given position
+ * in the binary index.  The term's postings are read a block at a time, and
+ * a block is only decoded if its last ID, from the block directory, is not
+ * below the next ID of the list.  list is freed if memory runs out.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int intersectTerm( QueryIndexPtr index, size_t position, QueryListPtr list )
+{
+	struct BICursor cursor;
+	uint32_t block_ids[BI_BLOCK_SIZE];
+
+	if( !BIOpenCursor( index->binary, position, &cursor ) || cursor.block_size > BI_BLOCK_SIZE )
+	{
+		QEFreeList( list );
+		return 0;
+	}
+
+	uint32_t* ids = list->ids;
+
+	/* IDs are written no further than they are read, so an owned list is intersected in place. */
+	if( !list->owned )
+	{
+		ids = malloc( ( list->count > 0 ? list->count : 1 ) * sizeof(*ids) );
+
+		if( ids == NULL )
+		{
+			QEFreeList( list );
+			return 0;
+		}
+	}
+
+	size_t count = 0;
+	size_t i = 0;
+	size_t block;
+
+	for( block = 0; block < cursor.block_count && i < list->count; block++ )
+	{
+		uint32_t last = BIBlockLast( &cursor, block );
+
+		if( last < list->ids[i] )
+		{
+			continue;
+		}
+
+		size_t expected = cursor.count - block * cursor.block_size;
+		size_t decoded = BIDecodeBlock( &cursor, block, block_ids, NULL );
+
+		if( decoded < ( expected < cursor.block_size ? expected : cursor.block_size ) )
+		{
+			if( ids != list->ids )
+			{
+				free( ids );
+			}
+			QEFreeList( list );
+			return 0;
+		}
+
+		/* The list's IDs up to the block's last one can only match in this block. */
+		size_t end = i;
+
+		while( end < list->count && list->ids[end] <= last )
+		{
+			end++;
+		}
+
+		count += intersectSorted( list->ids + i, end - i, block_ids, decoded, ids + count );
+		i = end;
+	}
+
+	if( ids != list->ids )
+	{
+		QEFreeList( list );
+	}
+
+	list->ids = ids;
+	list->count = count;
+	list->owned = 1;
+
+	return 1;
+}
+
+/**
+ * Read the text index in index->contents: the terms and their postings, and
+ * a path table in which the files are numbered in path order, as they are in
+ * a binary index (see numberFiles).
+ *
+ * Return 1 if successful, 0 if the file could not be parsed or memory ran out.
+ */
+static int loadText( QueryIndexPtr index )
+{
+	const char* p = index->contents->data;
+	const char* end = p + index->contents->length;
+	size_t term_capacity = 0;
+	PostingPtr postings = NULL;
+	size_t postings_capacity = 0;
+	size_t postings_count = 0;
+	size_t paths_capacity = 0;
+	int successful = 1;
+
+	/* Maps each path, in the file, to its ID + 1. */
+	HashTablePtr ids = HTCreate();
+
+	if( ids == NULL )
+	{
+		return 0;
+	}
+
+	while( successful )
+	{
+		size_t length;
+		const char* word = readWord( &p, end, &length );
+
+		if( word == NULL )
+		{
+			break;
+		}
+
+		/* The term is the rest of the line after "<list> ". */
+		if( length != 6 || memcmp( word, "<list>", 6 ) != 0 || p == end || *p != ' ' )
+		{
+			successful = 0;
+			break;
+		}
+
+		const char* term = ++p;
+
+		while( p < end && *p != '\n' )
+		{
+			p++;
+		}
+
+		if( index->term_count == term_capacity )
+		{
+			term_capacity = term_capacity == 0 ? 1024 : term_capacity * 2;
+			struct QueryTerm* terms = realloc( index->terms, term_capacity * sizeof(*terms) );
+
+			if( terms == NULL )
+			{
+				successful = 0;
+				break;
+			}
+
+			index->terms = terms;
+		}
+
+		struct QueryTerm* t = &index->terms[index->term_count++];
+		t->term = term;
+		t->term_length = p - term;
+		t->first = postings_count;
+		t->count = 0;
+
+		/* Then pairs of a path and a count, up to "</list>". */
+		while( 1 )
+		{
+			const char* path = readWord( &p, end, &length );
+
+			if( path == NULL )
+			{
+				successful = 0;
+				break;
+			}
+
+			if( length == 7 && memcmp( path, "</list>", 7 ) == 0 )
+			{
+				break;
+			}
+
+			size_t path_length = length;
+			const char* digits = readWord( &p, end, &length );
+			size_t appearances = 0;
+			size_t d;
+
+			for( d = 0; digits != NULL && d < length && isdigit( (unsigned char)digits[d] ); d++ )
+			{
+				appearances = appearances * 10 + ( digits[d] - '0' );
+			}
+
+			void** id = HTPut( ids, HashBytes( path, path_length ), path, path_length );
+
+			if( digits == NULL || d != length || id == NULL )
+			{
+				successful = 0;
+				break;
+			}
+
+			if( *id == NULL )
+			{
+				if( index->file_count == paths_capacity )
+				{
+					paths_capacity = paths_capacity == 0 ? 1024 : paths_capacity * 2;
+					char** paths = realloc( index->paths, paths_capacity * sizeof(*paths) );
+
+					if( paths == NULL )
+					{
+						successful = 0;
+						break;
+					}
+
+					index->paths = paths;
+				}
+
+				char* copy = malloc( path_length + 1 );
+
+				if( copy == NULL )
+				{
+					successful = 0;
+					break;
+				}
+
+				memcpy( copy, path, path_length );
+				copy[path_length] = '\0';
+				index->paths[index->file_count++] = copy;
+				*id = (void*)(uintptr_t)index->file_count;
+			}
+
+			if( postings_count == postings_capacity )
+			{
+				postings_capacity = postings_capacity == 0 ? 64 * 1024 : postings_capacity * 2;
+				PostingPtr grown = realloc( postings, postings_capacity * sizeof(*postings) );
+
+				if( grown == NULL )
+				{
+					successful = 0;
+					break;
+				}
+
+				postings = grown;
+			}
+
+			postings[postings_count].file_id = (uint32_t)( (uintptr_t)*id - 1 );
+			postings[postings_count++].appearances = appearances;
+			t->count++;
+		}
+	}
+
+	HTDestroy( ids );
+
+	if( successful )
+	{
+		successful = numberFiles( index, postings );
+	}
+
+	/* The IDs are kept apart from the appearances, so that lists of them can be intersected directly. */
+	if( successful )
+	{
+		index->ids = malloc( ( postings_count > 0 ? postings_count : 1 ) * sizeof(*index->ids) );
+		index->appearances = malloc( ( postings_count > 0 ? postings_count : 1 ) * sizeof(*index->appearances) );
+		successful = index->ids != NULL && index->appearances != NULL;
+	}
+
+	size_t i;
+
+	for( i = 0; i < postings_count && successful; i++ )
+	{
+		index->ids[i] = postings[i].file_id;
+		index->appearances[i] = postings[i].appearances;
+	}
+
+	free( postings );
+
+	return successful;
+}
+
+static QueryNodePtr newNode( QueryOp op )
+{
+	QueryNodePtr node = calloc( 1, sizeof(*node) );
+
+	if( node != NULL )
+	{
+		node->op = op;
+	}
+
+	return node;
+}
+
+/**
+ * Read the query's next token into parser.
+ */
+static void nextToken( struct QueryParser* parser )
+{
+	const char* p = parser->position;
+
+	while( *p != '\0' && *p != '(' && *p != ')' && !isalnum( (unsigned char)*p ) )
+	{
+		p++;
+	}
+
+	if( *p == '\0' )
+	{
+		parser->token = TOKEN_END;
+	}
+	else if( *p == '(' || *p == ')' )
+	{
+		parser->token = *p == '(' ? TOKEN_OPEN : TOKEN_CLOSE;
+		p++;
+	}
+	else
+	{
+		parser->word = p;
+
+		while( isalnum( (unsigned char)*p ) )
+		{
+			p++;
+		}
+
+		parser->word_length = p - parser->word;
+		parser->token = TOKEN_WORD;
+
+		if( parser->word_length == 3 && memcmp( parser->word, "AND", 3 ) == 0 )
+		{
+			parser->token = TOKEN_AND;
+		}
+		else if( parser->word_length == 2 && memcmp( parser->word, "OR", 2 ) == 0 )
+		{
+			parser->token = TOKEN_OR;
+		}
+		else if( parser->word_length == 3 && memcmp( parser->word, "NOT", 3 ) == 0 )
+		{
+			parser->token = TOKEN_NOT;
+		}
+	}
+
+	parser->position = p;
+}
+
+/**
+ * Renumber the files of the text index just read by loadText in path order,
+ * so that they are numbered as the indexer numbers them in a binary index
+ * and results from the two formats come out in the same order.  postings,
+ * which holds the postings of every term, is renumbered to match and each
+ * term's postings are put back in ascending order of file ID.
+ *
+ * Return 1 if successful, 0 if memory ran out.
+ */
+static int numberFiles( QueryIndexPtr index, PostingPtr postings )
+{
+	size_t file_count = index->file_count;
+	struct NumberedPath* files = malloc( ( file_count > 0 ? file_count : 1 ) * sizeof(*files) );
+	uint32_t* renumbered = malloc( ( file_count > 0 ? file_count : 1 ) * sizeof(*renumbered) );
+	size_t i;
+
+	if( files == NULL || renumbered == NULL )
+	{
+		free( files );
+		free( renumbered );
+		return 0;
+	}
+
+	for( i = 0; i < file_count; i++ )
+	{
+		files[i].path = index->paths[i];
+		files[i].id = i;
+	}
+
+	qsort( files, file_count, sizeof(*files), comparePaths );
+
+	for( i = 0; i < file_count; i++ )
+	{
+		index->paths[i] = files[i].path;
+		renumbered[files[i].id] = i;
+	}
+
+	for( i = 0; i < index->term_count; i++ )
+	{
+		struct QueryTerm* t = &index->terms[i];
+		size_t k;
+
+		for( k = t->first; k < t->first + t->count; k++ )
+		{
+			postings[k].file_id = renumbered[postings[k].file_id];
+		}
+
+		qsort( postings + t->first, t->count, sizeof(*postings), compareFileIDs );
+	}
+
+	free( files );
+	free( renumbered );
+
+	return 1;
+}
+
+/**
+ * Set cursor up at the first posting of the term at the given position in
+ * the index's dictionary.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int openCursor( QueryIndexPtr index, size_t position, struct RankCursor* cursor )
+{
+	memset( cursor, 0, sizeof(*cursor) );
+
+	if( index->binary != NULL )
+	{
+		if( !BIOpenCursor( index->binary, position, &cursor->postings ) || cursor->postings.block_size > BI_BLOCK_SIZE )
+		{
+			return 0;
+		}
+
+		cursor->count = cursor->postings.count;
+		cursor->block_size = cursor->postings.block_size;
+		cursor->block_count = cursor->postings.block_count;
+		cursor->max_weight = cursor->postings.max_weight;
+		cursor->decoded = (size_t)-1;
+	}
+	else
+	{
+		struct QueryTerm* t = &index->terms[position];
+
+		cursor->all_ids = index->ids + t->first;
+		cursor->all_appearances = index->appearances + t->first;
+		cursor->block_max = index->block_max + t->first_block;
+		cursor->count = t->count;
+		cursor->block_size = BI_BLOCK_SIZE;
+		cursor->block_count = ( t->count + BI_BLOCK_SIZE - 1 ) / BI_BLOCK_SIZE;
+		cursor->max_weight = t->max_weight;
+	}
+
+	cursor->idf = BM25IDF( cursor->count, index->ranked_count );
+
+	return cursorSeek( cursor, 0 );
+}
+
+/**
+ * Parse operands joined by AND, or by nothing.
+ *
+ * Return the operand, or an AND node of them, or NULL on error.
+ */
+static QueryNodePtr parseAnd( struct QueryParser* parser )
+{
+	QueryNodePtr first = parseUnary( parser );
+	QueryNodePtr node = first;
+
+	while( node != NULL && ( parser->token == TOKEN_AND || parser->token == TOKEN_WORD ||
+		parser->token == TOKEN_NOT || parser->token == TOKEN_OPEN ) )
+	{
+		if( parser->token == TOKEN_AND )
+		{
+			nextToken( parser );
+		}
+
+		if( node == first )
+		{
+			node = newNode( QUERY_AND );
+
+			if( node == NULL || !addChild( node, first ) )
+			{
+				free( node );
+				QEFreeNode( first );
+				return NULL;
+			}
+		}
+
+		QueryNodePtr child = parseUnary( parser );
+
+		if( child == NULL || !addChild( node, child ) )
+		{
+			QEFreeNode( child );
+			QEFreeNode( node );
+			return NULL;
+		}
+	}
+
+	return node;
+}
+
+/**
+ * Parse operands joined by OR.
+ *
+ * Return the operand, or an OR node of them, or NULL on error.
+ */
+static QueryNodePtr parseOr( struct QueryParser* parser )
+{
+	QueryNodePtr first = parseAnd( parser );
+	QueryNodePtr node = first;
+
+	while( node != NULL && parser->token == TOKEN_OR )
+	{
+		nextToken( parser );
+
+		if( node == first )
+		{
+			node = newNode( QUERY_OR );
+
+			if( node == NULL || !addChild( node, first ) )
+			{
+				free( node );
+				QEFreeNode( first );
+				return NULL;
+			}
+		}
+
+		QueryNodePtr child = parseAnd( parser );
+
+		if( child == NULL || !addChild( node, child ) )
+		{
+			QEFreeNode( child );
+			QEFreeNode( node );
+			return NULL;
+		}
+	}
+
+	return node;
+}
+
+/**
+ * Parse a term, a NOT and its operand, or a parenthesized query.
+ *
+ * Return the node, or NULL on error.
+ */
+static QueryNodePtr parseUnary( struct QueryParser* parser )
+{
+	QueryNodePtr node;
+
+	switch( parser->token )
+	{
+		case TOKEN_WORD:
+			node = newNode( QUERY_TERM );
+
+			if( node == NULL || ( node->term = malloc( parser->word_length + 1 ) ) == NULL )
+			{
+				free( node );
+				return NULL;
+			}
+
+			memcpy( node->term, parser->word, parser->word_length );
+			node->term[parser->word_length] = '\0';
+			node->term_length = parser->word_length;
+			nextToken( parser );
+			return node;
+
+		case TOKEN_NOT:
+			nextToken( parser );
+			QueryNodePtr operand = parseUnary( parser );
+
+			if( operand == NULL )
+			{
+				return NULL;
+			}
+
+			node = newNode( QUERY_NOT );
+
+			if( node == NULL || !addChild( node, operand ) )
+			{
+				free( node );
+				QEFreeNode( operand );
+				return NULL;
+			}
+			return node;
+
+		case TOKEN_OPEN:
+			nextToken( parser );
+			node = parseOr( parser );
+
+			if( node != NULL && parser->token != TOKEN_CLOSE )
+			{
+				parser->error = "missing )";
+				QEFreeNode( node );
+				return NULL;
+			}
+
+			nextToken( parser );
+			return node;
+
+		case TOKEN_CLOSE:
+			parser->error = "unexpected )";
+			return NULL;
+
+		case TOKEN_END:
+			parser->error = "expected a term at the end of the query";
+			return NULL;
+
+		default:
+			parser->error = "expected a term before AND or OR";
+			return NULL;
+	}
+}
+
+/**
+ * Read the next run of non-space characters at *p, no further than end, and
+ * move *p past it.
+ *
+ * Return the start of the run, and store its length in *length, or return
+ * NULL if there is none.
+ */
+static const char* readWord( const char** p, const char* end, size_t* length )
+{
+	const char* q = *p;
+
+	while( q < end && isspace( (unsigned char)*q ) )
+	{
+		q++;
+	}
+
+	if( q == end )
+	{
+		*p = q;
+		return NULL;
+	}
+
+	const char* word = q;
+
+	while( q < end && !isspace( (unsigned char)*q ) )
+	{
+		q++;
+	}
+
+	*length = q - word;
+	*p = q;
+
+	return word;
+}
+
+/**
+ * Restore the heap order of the count hits in heap, whose root is the worst
+ * hit, below node.
+ */
+static void siftDown( struct QueryHit* heap, size_t count, size_t node )
+{
+	while( 1 )
+	{
+		size_t worst = node;
+		size_t child = node * 2 + 1;
+
+		if( child < count && betterHit( &heap[worst], &heap[child] ) )
+		{
+			worst = child;
+		}
+
+		if( child + 1 < count && betterHit( &heap[worst], &heap[child + 1] ) )
+		{
+			worst = child + 1;
+		}
+
+		if( worst == node )
+		{
+			return;
+		}
+
+		struct QueryHit swap = heap[node];
+		heap[node] = heap[worst];
+		heap[worst] = swap;
+		node = worst;
+	}
+}
+
+/**
+ * Work out the weights that a binary index stores for a text index: each
+ * file's length, the sum of its terms' appearances, and each term's
+ * greatest weight overall and in each block of BI_BLOCK_SIZE postings.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int weighText( QueryIndexPtr index )
+{
+	size_t block_count = 0;
+	size_t i;
+	size_t t;
+
+	index->lengths = calloc( index->file_count > 0 ? index->file_count : 1, sizeof(*index->lengths) );
+
+	for( t = 0; t < index->term_count; t++ )
+	{
+		index->terms[t].first_block = block_count;
+		block_count += ( index->terms[t].count + BI_BLOCK_SIZE - 1 ) / BI_BLOCK_SIZE;
+	}
+
+	index->block_max = malloc( ( block_count > 0 ? block_count : 1 ) * sizeof(*index->block_max) );
+
+	if( index->lengths == NULL || index->block_max == NULL )
+	{
+		return 0;
+	}
+
+	for( t = 0; t < index->term_count; t++ )
+	{
+		for( i = index->terms[t].first; i < index->terms[t].first + index->terms[t].count; i++ )
+		{
+			index->lengths[index->ids[i]] += index->appearances[i];
+			index->average_length += index->appearances[i];
+		}
+	}
+
+	/* Every file of a text index has some term, so all of them are ranked. */
+	index->ranked_count = index->file_count;
+
+	if( index->file_count > 0 )
+	{
+		index->average_length /= index->file_count;
+	}
+
+	for( t = 0; t < index->term_count; t++ )
+	{
+		struct QueryTerm* term = &index->terms[t];
+		double idf = BM25IDF( term->count, index->file_count );
+		float* block_max = index->block_max + term->first_block;
+
+		term->max_weight = 0;
+
+		for( i = 0; i < term->count; i++ )
+		{
+			size_t p = term->first + i;
+			double weight = BM25Weight( idf, index->appearances[p], index->lengths[index->ids[p]], index->average_length );
+
+			if( i % BI_BLOCK_SIZE == 0 )
+			{
+				block_max[i / BI_BLOCK_SIZE] = 0;
+			}
+
+			/* Stored as floats, the bounds are rounded up so that they still hold. */
+			if( weight > block_max[i / BI_BLOCK_SIZE] )
+			{
+				block_max[i / BI_BLOCK_SIZE] = nextafterf( (float)weight, INFINITY );
+			}
+
+			if( block_max[i / BI_BLOCK_SIZE] > term->max_weight )
+			{
+				term->max_weight = block_max[i / BI_BLOCK_SIZE];
+			}
+		}
+	}
+
+	return 1;
+}
+
+QueryIndexPtr QEOpen( char* file_path )
+{
+	QueryIndexPtr index = calloc( 1, sizeof(*index) );
+
+	if( index == NULL )
+	{
+		return NULL;
+	}
+
+	index->contents = FMOpen( file_path );
+
+	if( index->contents == NULL )
+	{
+		free( index );
+		return NULL;
+	}
+
+	if( index->contents->length >= 8 && memcmp( index->contents->data, BI_MAGIC, 8 ) == 0 )
+	{
+		FMClose( index->contents );
+		index->contents = NULL;
+		index->binary = BIOpen( file_path );
+
+		if( index->binary == NULL )
+		{
+			free( index );
+			return NULL;
+		}
+
+		uint64_t id;
+
+		/* Files with no tokens are left out, as the writer left them out of the weights and a text index has none. */
+		for( id = 0; id < index->binary->header.file_count; id++ )
+		{
+			index->ranked_count += BILength( index->binary, (uint32_t)id ) > 0;
+		}
+
+		if( index->ranked_count > 0 )
+		{
+			index->average_length = (double)index->binary->header.total_length / index->ranked_count;
+		}
+
+		return index;
+	}
+
+	if( !loadText( index ) || !weighText( index ) )
+	{
+		QEClose( index );
+		return NULL;
+	}
+
+	return index;
+}
+
+size_t QEFileCount( QueryIndexPtr index )
+{
+	return index->binary != NULL ? index->binary->header.file_count : index->file_count;
+}
+
+size_t QETermCount( QueryIndexPtr index )
+{
+	return index->binary != NULL ? index->binary->header.term_count : index->term_count;
+}
+
+const char* QEPath( QueryIndexPtr index, uint32_t file_id )
+{
+	if( index->binary != NULL )
+	{
+		return BIPath( index->binary, file_id );
+	}
+
+	return file_id < index->file_count ? index->paths[file_id] : NULL;
+}
+
+const char* QETerm( QueryIndexPtr index, size_t position, size_t* length, size_t* count )
+{
+	if( index->binary != NULL )
+	{
+		struct BITermEntry entry = BITerm( index->binary, position );
+
+		*length = entry.string_length;
+		*count = entry.posting_count;
+		return BITermString( index->binary, position );
+	}
+
+	*length = index->terms[position].term_length;
+	*count = index->terms[position].count;
+	return index->terms[position].term;
+}
+
+int QEPostings( QueryIndexPtr index, size_t position, PostingPtr postings )
+{
+	if( index->binary != NULL )
+	{
+		return BIDecode( index->binary, position, postings ) == BITerm( index->binary, position ).posting_count;
+	}
+
+	struct QueryTerm* t = &index->terms[position];
+	size_t i;
+
+	for( i = 0; i < t->count; i++ )
+	{
+		postings[i].file_id = index->ids[t->first + i];
+		postings[i].appearances = index->appearances[t->first + i];
+	}
+
+	return 1;
+}
+
+int QELookup( QueryIndexPtr index, const char* term, size_t length, QueryListPtr list )
+{
+	size_t position;
+
+	memset( list, 0, sizeof(*list) );
+
+	if( !findTerm( index, term, length, &position ) )
+	{
+		return 1;
+	}
+
+	if( index->binary == NULL )
+	{
+		list->ids = index->ids + index->terms[position].first;
+		list->count = index->terms[position].count;
+		return 1;
+	}
+
+	struct BICursor cursor;
+	size_t block;
+
+	if( !BIOpenCursor( index->binary, position, &cursor ) )
+	{
+		return 0;
+	}
+
+	list->ids = malloc( ( cursor.count > 0 ? cursor.count : 1 ) * sizeof(*list->ids) );
+
+	if( list->ids == NULL )
+	{
+		return 0;
+	}
+
+	list->owned = 1;
+
+	for( block = 0; block < cursor.block_count; block++ )
+	{
+		size_t decoded = BIDecodeBlock( &cursor, block, list->ids + list->count, NULL );
+
+		list->count += decoded;
+
+		if( decoded == 0 || list->count > cursor.count )
+		{
+			break;
+		}
+	}
+
+	if( list->count != cursor.count )
+	{
+		QEFreeList( list );
+		return 0;
+	}
+
+	return 1;
+}
+
+QueryNodePtr QEParse( const char* query, const char** error )
+{
+	struct QueryParser parser;
+
+	memset( &parser, 0, sizeof(parser) );
+	parser.position = query;
+	nextToken( &parser );
+
+	QueryNodePtr node = parseOr( &parser );
+
+	if( node != NULL && parser.token != TOKEN_END )
+	{
+		parser.error = "unexpected )";
+		QEFreeNode( node );
+		node = NULL;
+	}
+
+	if( node == NULL )
+	{
+		*error = parser.error;
+	}
+
+	return node;
+}
+
+int QEEvaluate( QueryIndexPtr index, QueryNodePtr query, QueryListPtr result )
+{
+	struct QueryList child;
+	size_t c;
+
+	switch( query->op )
+	{
+		case QUERY_TERM:
+			return QELookup( index, query->term, query->term_length, result );
+
+		case QUERY_NOT:
+			if( !QEEvaluate( index, query->children[0], result ) )
+			{
+				return 0;
+			}
+
+			if( !complement( index, result ) )
+			{
+				QEFreeList( result );
+				return 0;
+			}
+			return 1;
+
+		case QUERY_AND:
+			return evaluateAnd( index, query, result );
+
+		case QUERY_OR:
+			if( !QEEvaluate( index, query->children[0], result ) )
+			{
+				return 0;
+			}
+
+			for( c = 1; c < query->child_count; c++ )
+			{
+				if( !QEEvaluate( index, query->children[c], &child ) )
+				{
+					QEFreeList( result );
+					return 0;
+				}
+
+				if( !combine( result, &child, COMBINE_OR ) )
+				{
+					return 0;
+				}
+			}
+			return 1;
+	}
+
+	return 0;
+}
+
+int QERank( QueryIndexPtr index, const char* query, size_t k, QueryHitPtr hits, size_t* count )
+{
+	struct QueryParser parser;
+	size_t term_count = 0;
+	size_t i;
+
+	*count = 0;
+
+	/* Every term is read as an AND node's would be; operators and parentheses are skipped. */
+	memset( &parser, 0, sizeof(parser) );
+	parser.position = query;
+
+	for( nextToken( &parser ); parser.token != TOKEN_END; nextToken( &parser ) )
+	{
+		term_count += parser.token == TOKEN_WORD;
+	}
+
+	struct RankCursor* cursors = malloc( ( term_count > 0 ? term_count : 1 ) * sizeof(*cursors) );
+	struct RankCursor** order = malloc( ( term_count > 0 ? term_count : 1 ) * sizeof(*order) );
+	size_t* positions = malloc( ( term_count > 0 ? term_count : 1 ) * sizeof(*positions) );
+	int successful = cursors != NULL && order != NULL && positions != NULL;
+	size_t n = 0;
+
+	parser.position = query;
+
+	for( nextToken( &parser ); successful && parser.token != TOKEN_END; nextToken( &parser ) )
+	{
+		size_t position;
+
+		if( parser.token != TOKEN_WORD || !findTerm( index, parser.word, parser.word_length, &position ) )
+		{
+			continue;
+		}
+
+		/* A term given twice counts once. */
+		for( i = 0; i < n && positions[i] != position; i++ )
+		{
+		}
+
+		if( i == n )
+		{
+			positions[n] = position;
+			successful = openCursor( index, position, &cursors[n] );
+			order[n] = &cursors[n];
+			n++;
+		}
+	}
+
+	/* hits is kept as a heap with the worst hit at its root until every file is ranked. */
+	size_t hit_count = 0;
+
+	while( successful && k > 0 )
+	{
+		double threshold = hit_count == k ? hits[0].score : 0;
+		double bound = 0;
+		size_t pivot;
+
+		/* The cursors are kept in order of file ID; few move at a time, so an insertion sort suits. */
+		for( i = 1; i < n; i++ )
+		{
+			struct RankCursor* cursor = order[i];
+			size_t j = i;
+
+			while( j > 0 && order[j - 1]->file_id > cursor->file_id )
+			{
+				order[j] = order[j - 1];
+				j--;
+			}
+
+			order[j] = cursor;
+		}
+
+		/* The pivot is the first file that the terms up to it could make score above the threshold. */
+		for( pivot = 0; pivot < n && order[pivot]->file_id != NO_FILE; pivot++ )
+		{
+			bound += order[pivot]->max_weight;
+
+			if( bound > threshold )
+			{
+				break;
+			}
+		}
+
+		if( pivot == n || order[pivot]->file_id == NO_FILE )
+		{
+			break;
+		}
+
+		uint32_t file_id = order[pivot]->file_id;
+
+		while( pivot + 1 < n && order[pivot + 1]->file_id == file_id )
+		{
+			pivot++;
+		}
+
+		/* Then the blocks that would hold the pivot file must be able to, too. */
+		uint64_t next = pivot + 1 < n ? order[pivot + 1]->file_id : (uint64_t)NO_FILE + 1;
+
+		bound = 0;
+
+		for( i = 0; i <= pivot; i++ )
+		{
+			size_t block = cursorShallow( order[i], file_id );
+
+			bound += cursorBlockMax( order[i], block );
+
+			if( (uint64_t)cursorBlockLast( order[i], block ) + 1 < next )
+			{
+				next = (uint64_t)cursorBlockLast( order[i], block ) + 1;
+			}
+		}
+
+		if( bound <= threshold )
+		{
+			/* No file before next can score above the threshold: each term's weight there is bounded by its current block's. */
+			for( i = 0; i <= pivot && successful; i++ )
+			{
+				successful = cursorSeek( order[i], next > file_id ? next : (uint64_t)file_id + 1 );
+			}
+			continue;
+		}
+
+		if( order[0]->file_id != file_id )
+		{
+			for( i = 0; i < pivot && successful; i++ )
+			{
+				successful = cursorSeek( order[i], file_id );
+			}
+			continue;
+		}
+
+		size_t length = index->binary != NULL ? BILength( index->binary, file_id ) : index->lengths[file_id];
+		struct QueryHit hit = { file_id, 0 };
+
+		for( i = 0; i <= pivot; i++ )
+		{
+			struct RankCursor* cursor = order[i];
+			size_t appearances = cursor->all_ids != NULL ? cursor->all_appearances[cursor->position]
+				: cursor->appearances[cursor->position % cursor->block_size];
+
+			hit.score += BM25Weight( cursor->idf, appearances, length, index->average_length );
+		}
+
+		if( hit_count < k )
+		{
+			/* Sift the new hit up from the bottom of the heap. */
+			size_t node = hit_count++;
+
+			while( node > 0 && betterHit( &hits[( node - 1 ) / 2], &hit ) )
+			{
+				hits[node] = hits[( node - 1 ) / 2];
+				node = ( node - 1 ) / 2;
+			}
+
+			hits[node] = hit;
+		}
+		else if( betterHit( &hit, &hits[0] ) )
+		{
+			hits[0] = hit;
+			siftDown( hits, hit_count, 0 );
+		}
+
+		for( i = 0; i <= pivot && successful; i++ )
+		{
+			successful = cursorSeek( order[i], (uint64_t)file_id + 1 );
+		}
+	}
+
+	/* Take the worst hit off the heap, to the end, until it is in order best first. */
+	*count = successful ? hit_count : 0;
+
+	while( hit_count > 1 )
+	{
+		struct QueryHit worst = hits[0];
+
+		hits[0] = hits[--hit_count];
+		siftDown( hits, hit_count, 0 );
+		hits[hit_count] = worst;
+	}
+
+	free( positions );
+	free( order );
+	free( cursors );
+
+	return successful;
+}
+
+void QEFreeList( QueryListPtr list )
+{
+	if( list->owned )
+	{
+		free( list->ids );
+	}
+
+	list->ids = NULL;
+	list->count = 0;
+	list->owned = 0;
+}
+
+void QEFreeNode( QueryNodePtr node )
+{
+	if( node == NULL )
+	{
+		return;
+	}
+
+	size_t c;
+
+	for( c = 0; c < node->child_count; c++ )
+	{
+		QEFreeNode( node->children[c] );
+	}
+
+	free( node->children );
+	free( node->term );
+	free( node );
+}
+
+void QEClose( QueryIndexPtr index )
+{
+	if( index == NULL )
+	{
+		return;
+	}
+
+	size_t i;
+
+	for( i = 0; i < index->file_count; i++ )
+	{
+		free( index->paths[i] );
+	}
+
+	BIClose( index->binary );
+	if( index->contents != NULL )
+	{
+		FMClose( index->contents );
+	}
+	free( index->paths );
+	free( index->ids );
+	free( index->appearances );
+	free( index->lengths );
+	free( index->block_max );
+	free( index->terms );
+	free( index );
+}
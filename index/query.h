@@ -0,0 +1,226 @@
+#ifndef index_query_h
+#define index_query_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "binary-index.h"
+#include "file-map.h"
+
+/*
+ * query.h
+ *
+ * Boolean queries over a written index, in either format.  A binary index
+ * is mapped and searched in place (see binary-index.h); a text index is read
+ * once into memory, with its files numbered in the order they first appear.
+ *
+ * A query is a list of terms combined with AND, OR and NOT, which bind in
+ * the order NOT, AND, OR, and with parentheses.  Terms next to each other
+ * are ANDed.  Terms are runs of letters and digits, matched exactly, as the
+ * indexer tokenizes files; any other character, except a parenthesis,
+ * separates terms.  So "cat dog OR NOT (bird fish)" finds the files that
+ * have both cat and dog, or that lack bird or fish.  A text index only
+ * lists the files that hold some term, so NOT only ever finds files with at
+ * least one token, in either format; an empty file matches no query.
+ *
+ * An AND intersects its operands from the one expected to match the fewest
+ * files up, so that the running result only shrinks.  Two lists of similar
+ * length are intersected by comparing four IDs of each at once; a list much
+ * shorter than the other gallops through it instead.  In a binary index, a
+ * term's postings are intersected a block at a time, and blocks past which
+ * the running result has no files are skipped without being decoded.
+ *
+ * A ranked query (see QERank) instead scores every file that contains any
+ * of its terms by BM25 (see bm25.h), and keeps the best k.  It follows
+ * block-max WAND: a file is only scored if the greatest weights of its
+ * terms, overall and then in the blocks that hold it, add up to more than
+ * the k-th best score so far, and whole blocks that cannot are skipped.  A
+ * binary index stores the greatest weights; a text index works them out
+ * when it is read, taking each file's length to be the sum of its terms'
+ * appearances, which is its number of tokens.
+ */
+
+/* A list at least this many times longer than the other is galloped through rather than merged with it. */
+#define QE_GALLOP_RATIO 32
+
+typedef enum
+{
+	QUERY_TERM,
+	QUERY_AND,
+	QUERY_OR,
+	QUERY_NOT
+} QueryOp;
+
+/*
+ * A node of a parsed query.  An AND or OR node has two or more children, a
+ * NOT node exactly one, and a term none.
+ */
+struct QueryNode
+{
+	QueryOp op;
+
+	/* The term of a QUERY_TERM node, null-terminated. */
+	char* term;
+	size_t term_length;
+
+	struct QueryNode** children;
+	size_t child_count;
+};
+typedef struct QueryNode* QueryNodePtr;
+
+/*
+ * A term of a text index, and where its postings start in the index's
+ * postings.
+ */
+struct QueryTerm
+{
+	const char* term;
+	size_t term_length;
+	size_t first;
+	size_t count;
+
+	/* The term's greatest weight, and where its blocks' greatest weights start in the index's. */
+	double max_weight;
+	size_t first_block;
+};
+
+struct QueryIndex
+{
+	/* The index if it is binary, or NULL if it is text. */
+	BinaryIndexPtr binary;
+
+	/* For a text index: the file, which the terms point into, and the terms in its descending order. */
+	FileContentsPtr contents;
+	struct QueryTerm* terms;
+	size_t term_count;
+
+	/* For a text index: every term's postings, each term's in file ID order, and the files' paths. */
+	uint32_t* ids;
+	size_t* appearances;
+	char** paths;
+	size_t file_count;
+
+	/* For a text index: each file's number of tokens, and the greatest weight in each block of each term. */
+	size_t* lengths;
+	float* block_max;
+
+	/* The number of files with any tokens, and their average number of tokens, for BM25. */
+	size_t ranked_count;
+	double average_length;
+};
+typedef struct QueryIndex* QueryIndexPtr;
+
+/*
+ * A list of file IDs in ascending order: a term's, or a query's result.
+ */
+struct QueryList
+{
+	uint32_t* ids;
+	size_t count;
+
+	/* 1 if ids was allocated for the list, 0 if it points into an index. */
+	int owned;
+};
+typedef struct QueryList* QueryListPtr;
+
+/*
+ * A file ranked by QERank, and its score.
+ */
+struct QueryHit
+{
+	uint32_t file_id;
+	double score;
+};
+typedef struct QueryHit* QueryHitPtr;
+
+/*
+ * QEOpen opens the index at file_path, binary or text, for queries.
+ *
+ * If the function succeeds, it returns a non-NULL QueryIndexPtr.
+ * Else it returns NULL.
+ */
+QueryIndexPtr QEOpen( char* file_path );
+
+/*
+ * QEFileCount returns the number of files in the index.
+ */
+size_t QEFileCount( QueryIndexPtr index );
+
+/*
+ * QETermCount returns the number of terms in the index.
+ */
+size_t QETermCount( QueryIndexPtr index );
+
+/*
+ * QEPath returns the null-terminated path of the file with the given ID, or
+ * NULL if there is no such file or the index is damaged there.
+ */
+const char* QEPath( QueryIndexPtr index, uint32_t file_id );
+
+/*
+ * QETerm returns the term at the given position of the index's dictionary,
+ * which is in descending order, stores its length in *length and its number
+ * of postings in *count.  The term need not be null-terminated.  It returns
+ * NULL if the index is damaged there.
+ */
+const char* QETerm( QueryIndexPtr index, size_t position, size_t* length, size_t* count );
+
+/*
+ * QEPostings writes the postings of the term at the given position of the
+ * index's dictionary, in file ID order, to postings, which must have room
+ * for the term's count.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int QEPostings( QueryIndexPtr index, size_t position, PostingPtr postings );
+
+/*
+ * QELookup stores the files that contain the length bytes at term in list,
+ * which is empty if the term is not in the index.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int QELookup( QueryIndexPtr index, const char* term, size_t length, QueryListPtr list );
+
+/*
+ * QEParse parses the null-terminated query.
+ *
+ * If the query is well-formed, it returns a non-NULL QueryNodePtr.  Else it
+ * returns NULL and, unless memory ran out, stores a description of the
+ * problem in *error.
+ */
+QueryNodePtr QEParse( const char* query, const char** error );
+
+/*
+ * QEEvaluate stores the files that match query in result.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int QEEvaluate( QueryIndexPtr index, QueryNodePtr query, QueryListPtr result );
+
+/*
+ * QERank scores the files that contain any of the terms of query, ignoring
+ * operators and parentheses, and stores the k best in hits, which must have
+ * room for k, from the highest score down; of files that score the same,
+ * those with lower IDs come first.  It stores the number of hits in *count,
+ * which is less than k if fewer files have any of the terms.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int QERank( QueryIndexPtr index, const char* query, size_t k, QueryHitPtr hits, size_t* count );
+
+/*
+ * QEFreeList frees the list's IDs, if it owns them, and empties it.
+ */
+void QEFreeList( QueryListPtr list );
+
+/*
+ * QEFreeNode destroys a parsed query.
+ */
+void QEFreeNode( QueryNodePtr node );
+
+/*
+ * QEClose closes the index and destroys it.
+ */
+void QEClose( QueryIndexPtr index );
+
+#endif
@@ -0,0 +1,917 @@
+#include <stdlib.h>
+#include <string.h>
+#include "run-file.h"
+#include "scheduler.h"
+
+/*
+ * A loser tree over the readers of a merge: each inner node holds the reader
+ * that lost the match played there, and node 0 the overall winner, the
+ * reader whose current term comes first.  When the winner moves on, only the
+ * matches on its way to the root are replayed, one comparison per level.
+ */
+struct LoserTree
+{
+	RunReaderPtr* readers;
+
+	/* 1 for a reader that still has terms in the range being merged. */
+	int* active;
+
+	/* count nodes: the winner, then the inner nodes of a tree whose leaves are count..2 * count - 1. */
+	size_t* losers;
+	size_t count;
+};
+
+/*
+ * One range of terms of a parallel merge, and where each run's part of it starts.
+ */
+struct MergeRange
+{
+	/* The range holds the terms that are at most upper and greater than lower; NULL for no bound. */
+	char* upper;
+	char* lower;
+
+	uint64_t* starts;
+
+	/* The file the range is merged into. */
+	char* path;
+	int successful;
+};
+
+/*
+ * State shared by the threads of a parallel merge.
+ */
+struct Merge
+{
+	char** paths;
+	size_t count;
+	struct MergeRange* ranges;
+	RFMergeFn emit;
+	void* context;
+};
+
+/*
+ * A sampled term, weighed by the bytes of its run up to the next sample.
+ */
+struct WeightedSample
+{
+	char* term;
+	uint64_t weight;
+};
+
+static void advance( struct LoserTree* tree, size_t reader, const char* upper, const char* lower );
+static int beats( struct LoserTree* tree, size_t a, size_t b );
+static size_t buildTree( struct LoserTree* tree, size_t node );
+static int compareSamples( const void* a, const void* b );
+static int copyFile( char* path, FILE* output );
+static void freeSamples( RunSamplePtr samples, size_t count );
+static int mergeRange( char** paths, size_t count, uint64_t* starts, const char* upper, const char* lower, FILE* output, RFMergeFn emit, void* context );
+static void mergeRangeTask( void* merge, int worker, size_t range );
+static int readSamples( char* path, RunSamplePtr* samples, size_t* count, uint64_t* end );
+static int readVarint( RunReaderPtr reader, uint64_t* value );
+static void replay( struct LoserTree* tree, size_t reader );
+static void writeBytes( RunWriterPtr writer, const void* bytes, size_t length );
+static void writeVarint( RunWriterPtr writer, uint64_t value );
+
+/**
+ * Move the given reader of tree on to its next term in the range bounded by
+ * upper and lower, skipping terms above the range, and mark it inactive if
+ * there is none.
+ */
+static void advance( struct LoserTree* tree, size_t reader, const char* upper, const char* lower )
+{
+	RunReaderPtr r = tree->readers[reader];
+
+	while( RFNext( r ) )
+	{
+		if( upper != NULL && strcmp( r->term, upper ) > 0 )
+		{
+			continue;
+		}
+
+		tree->active[reader] = lower == NULL || strcmp( r->term, lower ) > 0;
+		return;
+	}
+
+	tree->active[reader] = 0;
+}
+
+/**
+ * Return 1 if reader a's current term comes before reader b's, 0 otherwise.
+ * An inactive reader comes after every active one, and ties go to the lower
+ * reader so that the order is total.
+ */
+static int beats( struct LoserTree* tree, size_t a, size_t b )
+{
+	if( !tree->active[a] || !tree->active[b] )
+	{
+		return tree->active[a] || ( !tree->active[b] && a < b );
+	}
+
+	int order = strcmp( tree->readers[a]->term, tree->readers[b]->term );
+
+	return order > 0 || ( order == 0 && a < b );
+}
+
+/**
+ * Play every match below node, recording the losers.
+ *
+ * Return the reader that wins at node.
+ */
+static size_t buildTree( struct LoserTree* tree, size_t node )
+{
+	if( node >= tree->count )
+	{
+		return node - tree->count;
+	}
+
+	size_t a = buildTree( tree, node * 2 );
+	size_t b = buildTree( tree, node * 2 + 1 );
+
+	if( beats( tree, a, b ) )
+	{
+		tree->losers[node] = b;
+		return a;
+	}
+
+	tree->losers[node] = a;
+	return b;
+}
+
+/**
+ * qsort comparator putting struct WeightedSamples in descending order of term.
+ */
+static int compareSamples( const void* a, const void* b )
+{
+	return strcmp( ((const struct WeightedSample*)b)->term, ((const struct WeightedSample*)a)->term );
+}
+
+/**
+ * Append the contents of the file at path to output.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int copyFile( char* path, FILE* output )
+{
+	FILE* file = fopen( path, "rb" );
+	char* buffer = malloc( RF_BUFFER_SIZE );
+	int successful = file != NULL && buffer != NULL;
+	size_t length;
+
+	while( successful && ( length = fread( buffer, 1, RF_BUFFER_SIZE, file ) ) > 0 )
+	{
+		successful = fwrite( buffer, 1, length, output ) == length;
+	}
+
+	if( file != NULL )
+	{
+		if( ferror( file ) )
+		{
+			successful = 0;
+		}
+		fclose( file );
+	}
+
+	free( buffer );
+
+	return successful;
+}
+
+static void freeSamples( RunSamplePtr samples, size_t count )
+{
+	size_t i;
+
+	for( i = 0; samples != NULL && i < count; i++ )
+	{
+		free( samples[i].term );
+	}
+
+	free( samples );
+}
+
+/**
+ * Merge the terms of the count runs at paths that fall between upper and
+ * lower (see struct MergeRange), reading each run from its offset in starts,
+ * or from its first term if starts is NULL.  The readers are kept in a loser
+ * tree ordered by current term; each term's postings are gathered from every
+ * reader on it, which are then moved on, before the term is emitted.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int mergeRange( char** paths, size_t count, uint64_t* starts, const char* upper, const char* lower, FILE* output, RFMergeFn emit, void* context )
+{
+	struct LoserTree tree;
+	int successful = 1;
+	size_t i;
+
+	if( count == 0 )
+	{
+		return 1;
+	}
+
+	tree.count = count;
+	tree.readers = calloc( count, sizeof(*tree.readers) );
+	tree.active = calloc( count, sizeof(*tree.active) );
+	tree.losers = malloc( count * sizeof(*tree.losers) );
+
+	if( tree.readers == NULL || tree.active == NULL || tree.losers == NULL )
+	{
+		successful = 0;
+	}
+
+	for( i = 0; successful && i < count; i++ )
+	{
+		tree.readers[i] = RFOpen( paths[i] );
+
+		if( tree.readers[i] == NULL )
+		{
+			successful = 0;
+			break;
+		}
+
+		if( starts != NULL && fseek( tree.readers[i]->file, starts[i], SEEK_SET ) == 0 )
+		{
+			tree.readers[i]->position = starts[i];
+		}
+
+		advance( &tree, i, upper, lower );
+	}
+
+	if( successful )
+	{
+		tree.losers[0] = buildTree( &tree, 1 );
+	}
+
+	/* The term being gathered, and its postings from every run. */
+	char* term = NULL;
+	size_t term_capacity = 0;
+	PostingPtr postings = NULL;
+	size_t postings_count;
+	size_t postings_capacity = 0;
+
+	while( successful && tree.active[tree.losers[0]] )
+	{
+		RunReaderPtr top = tree.readers[tree.losers[0]];
+		size_t term_length = top->term_length;
+
+		if( term_length + 1 > term_capacity )
+		{
+			term_capacity = term_length + 1;
+			free( term );
+			term = malloc( term_capacity );
+
+			if( term == NULL )
+			{
+				successful = 0;
+				break;
+			}
+		}
+
+		memcpy( term, top->term, term_length + 1 );
+		postings_count = 0;
+
+		while( tree.active[tree.losers[0]] && strcmp( tree.readers[tree.losers[0]]->term, term ) == 0 )
+		{
+			size_t winner = tree.losers[0];
+			RunReaderPtr reader = tree.readers[winner];
+
+			if( postings_count + reader->count > postings_capacity )
+			{
+				size_t capacity = ( postings_count + reader->count ) * 2;
+				PostingPtr grown = realloc( postings, capacity * sizeof(*grown) );
+
+				if( grown == NULL )
+				{
+					successful = 0;
+					break;
+				}
+
+				postings = grown;
+				postings_capacity = capacity;
+			}
+
+			memcpy( postings + postings_count, reader->postings, reader->count * sizeof(*postings) );
+			postings_count += reader->count;
+
+			advance( &tree, winner, upper, lower );
+			replay( &tree, winner );
+		}
+
+		if( successful && !emit( context, output, term, term_length, postings, postings_count ) )
+		{
+			successful = 0;
+		}
+	}
+
+	for( i = 0; tree.readers != NULL && i < count; i++ )
+	{
+		if( tree.readers[i] != NULL )
+		{
+			if( tree.readers[i]->failed )
+			{
+				successful = 0;
+			}
+			RFCloseReader( tree.readers[i] );
+		}
+	}
+
+	free( term );
+	free( postings );
+	free( tree.readers );
+	free( tree.active );
+	free( tree.losers );
+
+	return successful;
+}
+
+/**
+ * Scheduler task for a parallel merge: merge one range into its own file.
+ */
+static void mergeRangeTask( void* merge, int worker, size_t range )
+{
+	struct Merge* self = merge;
+	struct MergeRange* r = &self->ranges[range];
+	FILE* file = fopen( r->path, "wb" );
+	char* buffer = malloc( RF_BUFFER_SIZE );
+
+	if( file == NULL || buffer == NULL )
+	{
+		if( file != NULL )
+		{
+			fclose( file );
+		}
+		free( buffer );
+		r->successful = 0;
+		return;
+	}
+
+	setvbuf( file, buffer, _IOFBF, RF_BUFFER_SIZE );
+
+	r->successful = mergeRange( self->paths, self->count, r->starts, r->upper, r->lower, file, self->emit, self->context );
+
+	if( fclose( file ) != 0 )
+	{
+		r->successful = 0;
+	}
+
+	free( buffer );
+}
+
+/**
+ * Read the samples of the run at path into a new array of *count samples,
+ * and where its terms end into *end.
+ *
+ * Return 1 if successful, 0 otherwise.
+ */
+static int readSamples( char* path, RunSamplePtr* samples, size_t* count, uint64_t* end )
+{
+	RunReaderPtr reader = RFOpen( path );
+	uint64_t n;
+	size_t i;
+
+	*samples = NULL;
+	*count = 0;
+
+	if( reader == NULL )
+	{
+		return 0;
+	}
+
+	*end = reader->end;
+
+	if( fseek( reader->file, reader->end, SEEK_SET ) != 0 || !readVarint( reader, &n ) )
+	{
+		RFCloseReader( reader );
+		return 0;
+	}
+
+	*samples = calloc( n > 0 ? n : 1, sizeof(**samples) );
+
+	for( i = 0; *samples != NULL && i < n; i++ )
+	{
+		uint64_t length;
+		RunSamplePtr s = &(*samples)[i];
+
+		if( !readVarint( reader, &s->offset ) || !readVarint( reader, &length ) )
+		{
+			break;
+		}
+
+		s->term = malloc( length + 1 );
+
+		if( s->term == NULL || fread( s->term, 1, length, reader->file ) != length )
+		{
+			break;
+		}
+
+		s->term[length] = '\0';
+		*count = i + 1;
+	}
+
+	RFCloseReader( reader );
+
+	if( *count != n )
+	{
+		freeSamples( *samples, n );
+		*samples = NULL;
+		*count = 0;
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Read a varint from reader's file into *value.
+ *
+ * Return 1 if successful, 0 at the end of the file or if the varint is malformed.
+ */
+static int readVarint( RunReaderPtr reader, uint64_t* value )
+{
+	uint64_t v = 0;
+	int shift = 0;
+	int c;
+
+	do
+	{
+		c = getc( reader->file );
+
+		if( c == EOF || shift > 63 )
+		{
+			return 0;
+		}
+
+		reader->position++;
+		v |= (uint64_t)( c & 0x7F ) << shift;
+		shift += 7;
+	}
+	while( c & 0x80 );
+
+	*value = v;
+
+	return 1;
+}
+
+/**
+ * Replay the matches on the way from the given reader's leaf to the root,
+ * after it has moved on to its next term.
+ */
+static void replay( struct LoserTree* tree, size_t reader )
+{
+	size_t winner = reader;
+	size_t node;
+
+	for( node = ( reader + tree->count ) / 2; node >= 1; node /= 2 )
+	{
+		if( beats( tree, tree->losers[node], winner ) )
+		{
+			size_t loser = winner;
+			winner = tree->losers[node];
+			tree->losers[node] = loser;
+		}
+	}
+
+	tree->losers[0] = winner;
+}
+
+/**
+ * Write length bytes to the run.  Errors are left for RFClose to find.
+ */
+static void writeBytes( RunWriterPtr writer, const void* bytes, size_t length )
+{
+	fwrite( bytes, 1, length, writer->file );
+	writer->position += length;
+}
+
+/**
+ * Write value to the run as a varint.  Errors are left for RFClose to find.
+ */
+static void writeVarint( RunWriterPtr writer, uint64_t value )
+{
+	while( value >= 0x80 )
+	{
+		putc( (int)( ( value & 0x7F ) | 0x80 ), writer->file );
+		value >>= 7;
+		writer->position++;
+	}
+
+	putc( (int)value, writer->file );
+	writer->position++;
+}
+
+RunWriterPtr RFCreate( char* file_path )
+{
+	RunWriterPtr writer = calloc( 1, sizeof(*writer) );
+
+	if( writer == NULL )
+	{
+		return NULL;
+	}
+
+	writer->file = fopen( file_path, "wb" );
+	writer->buffer = malloc( RF_BUFFER_SIZE );
+
+	if( writer->file == NULL || writer->buffer == NULL )
+	{
+		if( writer->file != NULL )
+		{
+			fclose( writer->file );
+		}
+		free( writer->buffer );
+		free( writer );
+		return NULL;
+	}
+
+	setvbuf( writer->file, writer->buffer, _IOFBF, RF_BUFFER_SIZE );
+
+	return writer;
+}
+
+int RFWrite( RunWriterPtr writer, const char* term, size_t term_length, PostingPtr postings, size_t count )
+{
+	size_t i;
+
+	if( writer->sample_count == 0 || writer->position - writer->last_sample >= RF_SAMPLE_BYTES )
+	{
+		if( writer->sample_count == writer->sample_capacity )
+		{
+			size_t capacity = writer->sample_capacity > 0 ? writer->sample_capacity * 2 : 64;
+			RunSamplePtr samples = realloc( writer->samples, capacity * sizeof(*samples) );
+
+			if( samples == NULL )
+			{
+				return 0;
+			}
+
+			writer->samples = samples;
+			writer->sample_capacity = capacity;
+		}
+
+		RunSamplePtr s = &writer->samples[writer->sample_count];
+		s->term = malloc( term_length + 1 );
+
+		if( s->term == NULL )
+		{
+			return 0;
+		}
+
+		memcpy( s->term, term, term_length );
+		s->term[term_length] = '\0';
+		s->offset = writer->position;
+		writer->last_sample = writer->position;
+		writer->sample_count++;
+	}
+
+	writeVarint( writer, term_length );
+	writeBytes( writer, term, term_length );
+	writeVarint( writer, count );
+
+	for( i = 0; i < count; i++ )
+	{
+		writeVarint( writer, postings[i].file_id );
+		writeVarint( writer, postings[i].appearances );
+	}
+
+	return !ferror( writer->file );
+}
+
+int RFClose( RunWriterPtr writer )
+{
+	uint64_t footer = writer->position;
+	size_t i;
+
+	writeVarint( writer, writer->sample_count );
+
+	for( i = 0; i < writer->sample_count; i++ )
+	{
+		size_t length = strlen( writer->samples[i].term );
+
+		writeVarint( writer, writer->samples[i].offset );
+		writeVarint( writer, length );
+		writeBytes( writer, writer->samples[i].term, length );
+	}
+
+	for( i = 0; i < 8; i++ )
+	{
+		putc( (int)( ( footer >> ( i * 8 ) ) & 0xFF ), writer->file );
+	}
+
+	int successful = !ferror( writer->file );
+
+	/* The buffer is only freed once fclose has flushed it. */
+	if( fclose( writer->file ) != 0 )
+	{
+		successful = 0;
+	}
+
+	freeSamples( writer->samples, writer->sample_count );
+	free( writer->buffer );
+	free( writer );
+
+	return successful;
+}
+
+RunReaderPtr RFOpen( char* file_path )
+{
+	RunReaderPtr reader = calloc( 1, sizeof(*reader) );
+	unsigned char trailer[8];
+	int i;
+
+	if( reader == NULL )
+	{
+		return NULL;
+	}
+
+	reader->file = fopen( file_path, "rb" );
+	reader->buffer = malloc( RF_READ_BUFFER_SIZE );
+
+	if( reader->file == NULL || reader->buffer == NULL )
+	{
+		RFCloseReader( reader );
+		return NULL;
+	}
+
+	setvbuf( reader->file, reader->buffer, _IOFBF, RF_READ_BUFFER_SIZE );
+
+	/* Find where the terms end from the trailer. */
+	if( fseek( reader->file, -8, SEEK_END ) != 0 || fread( trailer, 1, 8, reader->file ) != 8 ||
+		fseek( reader->file, 0, SEEK_SET ) != 0 )
+	{
+		RFCloseReader( reader );
+		return NULL;
+	}
+
+	for( i = 7; i >= 0; i-- )
+	{
+		reader->end = reader->end << 8 | trailer[i];
+	}
+
+	return reader;
+}
+
+int RFNext( RunReaderPtr reader )
+{
+	uint64_t length;
+	uint64_t count;
+	size_t i;
+
+	if( reader->position >= reader->end )
+	{
+		return 0;
+	}
+
+	if( !readVarint( reader, &length ) )
+	{
+		reader->failed = 1;
+		return 0;
+	}
+
+	if( length + 1 > reader->term_capacity )
+	{
+		char* term = realloc( reader->term, length + 1 );
+
+		if( term == NULL )
+		{
+			reader->failed = 1;
+			return 0;
+		}
+
+		reader->term = term;
+		reader->term_capacity = length + 1;
+	}
+
+	if( fread( reader->term, 1, length, reader->file ) != length )
+	{
+		reader->failed = 1;
+		return 0;
+	}
+
+	reader->position += length;
+	reader->term[length] = '\0';
+	reader->term_length = length;
+
+	if( !readVarint( reader, &count ) )
+	{
+		reader->failed = 1;
+		return 0;
+	}
+
+	if( count > reader->capacity )
+	{
+		PostingPtr postings = realloc( reader->postings, count * sizeof(*postings) );
+
+		if( postings == NULL )
+		{
+			reader->failed = 1;
+			return 0;
+		}
+
+		reader->postings = postings;
+		reader->capacity = count;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		uint64_t file_id;
+		uint64_t appearances;
+
+		if( !readVarint( reader, &file_id ) || !readVarint( reader, &appearances ) || file_id > UINT32_MAX )
+		{
+			reader->failed = 1;
+			return 0;
+		}
+
+		reader->postings[i].file_id = file_id;
+		reader->postings[i].appearances = appearances;
+	}
+
+	reader->count = count;
+
+	return 1;
+}
+
+void RFCloseReader( RunReaderPtr reader )
+{
+	if( reader->file != NULL )
+	{
+		fclose( reader->file );
+	}
+
+	free( reader->buffer );
+	free( reader->term );
+	free( reader->postings );
+	free( reader );
+}
+
+/**
+ * With one thread, the runs are merged straight into output.  Otherwise the
+ * samples of every run are sorted together, and cut into ranges of about
+ * even weight at sampled terms.  Each range is merged into its own file by
+ * the scheduler's workers, and the files are then copied to output in order.
+ */
+int RFMerge( char** paths, size_t count, int threads, char* directory, FILE* output, RFMergeFn emit, void* context )
+{
+	if( threads <= 1 || count == 0 )
+	{
+		return mergeRange( paths, count, NULL, NULL, NULL, output, emit, context );
+	}
+
+	RunSamplePtr* samples = calloc( count, sizeof(*samples) );
+	size_t* sample_counts = calloc( count, sizeof(*sample_counts) );
+	uint64_t* ends = calloc( count, sizeof(*ends) );
+	size_t total_samples = 0;
+	int successful = samples != NULL && sample_counts != NULL && ends != NULL;
+	size_t i;
+	size_t j;
+
+	for( i = 0; successful && i < count; i++ )
+	{
+		successful = readSamples( paths[i], &samples[i], &sample_counts[i], &ends[i] );
+		total_samples += sample_counts[i];
+	}
+
+	/* Weigh each sample by the bytes up to the next one in its run, and sort them all together. */
+	struct WeightedSample* weighted = malloc( ( total_samples > 0 ? total_samples : 1 ) * sizeof(*weighted) );
+	size_t wanted = (size_t)threads * RF_RANGES_PER_THREAD;
+	char** splitters = malloc( wanted * sizeof(*splitters) );
+	size_t* sizes = malloc( wanted * sizeof(*sizes) );
+	struct MergeRange* ranges = calloc( wanted, sizeof(*ranges) );
+	uint64_t total = 0;
+	size_t range_count = 0;
+
+	if( weighted == NULL || splitters == NULL || sizes == NULL || ranges == NULL )
+	{
+		successful = 0;
+	}
+
+	if( successful )
+	{
+		size_t w = 0;
+
+		for( i = 0; i < count; i++ )
+		{
+			RunSamplePtr s = samples[i];
+
+			for( j = 0; j < sample_counts[i]; j++ )
+			{
+				uint64_t next = j + 1 < sample_counts[i] ? s[j + 1].offset : ends[i];
+
+				weighted[w].term = s[j].term;
+				weighted[w].weight = next - s[j].offset;
+				total += weighted[w].weight;
+				w++;
+			}
+		}
+
+		qsort( weighted, total_samples, sizeof(*weighted), compareSamples );
+
+		/* Cut the sorted samples into ranges of about total / wanted bytes, at distinct terms. */
+		uint64_t weight = 0;
+		uint64_t last_cut = 0;
+		size_t splitter_count = 0;
+
+		for( i = 0; i < total_samples; i++ )
+		{
+			if( splitter_count + 1 < wanted && weight > 0 && weight >= total / wanted * ( splitter_count + 1 ) &&
+				( splitter_count == 0 || strcmp( weighted[i].term, splitters[splitter_count - 1] ) < 0 ) )
+			{
+				splitters[splitter_count] = weighted[i].term;
+				sizes[splitter_count] = weight - last_cut;
+				last_cut = weight;
+				splitter_count++;
+			}
+
+			weight += weighted[i].weight;
+		}
+
+		sizes[splitter_count] = weight - last_cut;
+		range_count = splitter_count + 1;
+	}
+
+	if( successful && range_count == 1 )
+	{
+		successful = mergeRange( paths, count, NULL, NULL, NULL, output, emit, context );
+		range_count = 0;
+	}
+
+	/* Bound each range, and find where each run's part of it starts: at the last sample above the range. */
+	for( i = 0; successful && i < range_count; i++ )
+	{
+		struct MergeRange* r = &ranges[i];
+
+		r->upper = i > 0 ? splitters[i - 1] : NULL;
+		r->lower = i + 1 < range_count ? splitters[i] : NULL;
+		r->starts = calloc( count, sizeof(*r->starts) );
+		r->path = malloc( strlen( directory ) + 32 );
+
+		if( r->starts == NULL || r->path == NULL )
+		{
+			successful = 0;
+			break;
+		}
+
+		sprintf( r->path, "%s/part-%zu", directory, i );
+
+		for( j = 0; r->upper != NULL && j < count; j++ )
+		{
+			size_t k;
+
+			for( k = 0; k < sample_counts[j] && strcmp( samples[j][k].term, r->upper ) > 0; k++ )
+			{
+				r->starts[j] = samples[j][k].offset;
+			}
+		}
+	}
+
+	if( successful && range_count > 0 )
+	{
+		struct Merge merge;
+		merge.paths = paths;
+		merge.count = count;
+		merge.ranges = ranges;
+		merge.emit = emit;
+		merge.context = context;
+
+		SchedulerPtr scheduler = SchedCreate( sizes, range_count, threads );
+
+		/* If no thread could be started, fall back to merging on this one. */
+		if( scheduler == NULL || SchedRun( scheduler, mergeRangeTask, &merge ) == 0 )
+		{
+			for( i = 0; i < range_count; i++ )
+			{
+				mergeRangeTask( &merge, 0, i );
+			}
+		}
+
+		SchedDestroy( scheduler );
+
+		for( i = 0; i < range_count; i++ )
+		{
+			if( successful && !( ranges[i].successful && copyFile( ranges[i].path, output ) ) )
+			{
+				successful = 0;
+			}
+			remove( ranges[i].path );
+		}
+	}
+
+	for( i = 0; ranges != NULL && i < wanted; i++ )
+	{
+		free( ranges[i].starts );
+		free( ranges[i].path );
+	}
+
+	for( i = 0; samples != NULL && i < count; i++ )
+	{
+		freeSamples( samples[i], sample_counts[i] );
+	}
+
+	free( ranges );
+	free( sizes );
+	free( splitters );
+	free( weighted );
+	free( ends );
+	free( sample_counts );
+	free( samples );
+
+	return successful;
+}
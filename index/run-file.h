@@ -0,0 +1,159 @@
+#ifndef index_run_file_h
+#define index_run_file_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "postings.h"
+
+/*
+ * run-file.h
+ *
+ * Sorted runs: part of an index, spilled to disk when the index outgrows its
+ * memory budget, to be merged with the other runs once every file is read.
+ *
+ * A run holds terms in descending strcmp order, the order of the final
+ * output.  Each term is written as a varint length, the term's bytes, a
+ * varint posting count, and then each posting as a varint file ID and a
+ * varint number of appearances.  Postings are in no particular order, and a
+ * term's postings may be spread over several runs, each file in only one.
+ *
+ * The terms are followed by a footer of samples: the first term, and then
+ * the first term after every RF_SAMPLE_BYTES bytes, each with its offset in
+ * the run, written as a varint count and then a varint offset, varint length
+ * and bytes per sample.  The last 8 bytes of the file are the footer's
+ * offset, which is where the terms end, little-endian.  The samples let a
+ * merge split the terms of all the runs into ranges of about even size and
+ * start reading each run at a range.
+ */
+
+/* The stdio buffer size of run writers and of other sequential copies. */
+#define RF_BUFFER_SIZE (1024 * 1024)
+
+/* The stdio buffer size of run readers, kept small since a merge has one per run per thread. */
+#define RF_READ_BUFFER_SIZE (64 * 1024)
+
+/* A run's terms are sampled about this many bytes apart. */
+#define RF_SAMPLE_BYTES (64 * 1024)
+
+/* A parallel merge splits the terms into this many ranges per thread, so that the threads stay balanced. */
+#define RF_RANGES_PER_THREAD 4
+
+/*
+ * A sampled term of a run, and the offset in the run at which it starts.
+ */
+struct RunSample
+{
+	char* term;
+	uint64_t offset;
+};
+typedef struct RunSample* RunSamplePtr;
+
+struct RunWriter
+{
+	FILE* file;
+	char* buffer;
+
+	/* The number of bytes written so far, and where the last sampled term starts. */
+	uint64_t position;
+	uint64_t last_sample;
+
+	RunSamplePtr samples;
+	size_t sample_count;
+	size_t sample_capacity;
+};
+typedef struct RunWriter* RunWriterPtr;
+
+struct RunReader
+{
+	FILE* file;
+	char* buffer;
+
+	/* The offset of the next byte to be read, and where the terms end. */
+	uint64_t position;
+	uint64_t end;
+
+	/* The current term, null-terminated, and its postings; the buffers are reused for every term. */
+	char* term;
+	size_t term_length;
+	size_t term_capacity;
+	PostingPtr postings;
+	size_t count;
+	size_t capacity;
+
+	/* 1 if the run could not be read to its end. */
+	int failed;
+};
+typedef struct RunReader* RunReaderPtr;
+
+/*
+ * The function called by RFMerge for each term, with all of its postings
+ * from every run, in no particular order, to write the term to file.  term
+ * is null-terminated, and it and postings are only valid during the call.
+ * In a parallel merge it is called from several threads at once, each with
+ * its own file.
+ *
+ * Returns 1 if successful, 0 to stop the merge.
+ */
+typedef int (*RFMergeFn)( void* context, FILE* file, char* term, size_t term_length, PostingPtr postings, size_t count );
+
+/*
+ * RFCreate creates a new, empty run file at file_path.
+ *
+ * If the function succeeds, it returns a non-NULL RunWriterPtr.
+ * Else it returns NULL.
+ */
+RunWriterPtr RFCreate( char* file_path );
+
+/*
+ * RFWrite appends a term and its count postings to the run.  Terms must be
+ * written in descending strcmp order.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int RFWrite( RunWriterPtr writer, const char* term, size_t term_length, PostingPtr postings, size_t count );
+
+/*
+ * RFClose writes the run's footer, finishes the run and destroys the writer.
+ *
+ * If every byte of the run was written, it returns 1.  Else, it returns 0.
+ */
+int RFClose( RunWriterPtr writer );
+
+/*
+ * RFOpen opens the run file at file_path for reading from its first term.
+ * No term is current until the first RFNext.
+ *
+ * If the function succeeds, it returns a non-NULL RunReaderPtr.
+ * Else it returns NULL.
+ */
+RunReaderPtr RFOpen( char* file_path );
+
+/*
+ * RFNext reads the run's next term and its postings into reader.
+ *
+ * Returns 1 if a term was read, 0 at the end of the run or if it could not
+ * be read, in which case reader->failed is set.
+ */
+int RFNext( RunReaderPtr reader );
+
+/*
+ * RFCloseReader closes the run file and destroys the reader.
+ */
+void RFCloseReader( RunReaderPtr reader );
+
+/*
+ * RFMerge reads the count runs at paths and calls emit once per distinct
+ * term, with the term's postings from all of the runs, so that the terms
+ * are written to output in descending strcmp order.
+ *
+ * With more than one thread, the terms are split into ranges that are
+ * merged at once, each into its own file in directory; the files are then
+ * copied to output in order, and removed.
+ *
+ * If every run was read and every call succeeded, it returns 1.  Else, it
+ * returns 0.
+ */
+int RFMerge( char** paths, size_t count, int threads, char* directory, FILE* output, RFMergeFn emit, void* context );
+
+#endif
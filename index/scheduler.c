@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <time.h>
+#include "scheduler.h"
+
+/*
+ * An item's size paired with its position, for sorting items by size.
+ */
+struct SizedItem
+{
+	size_t size;
+	size_t item;
+};
+
+/*
+ * Arguments to a worker thread.
+ */
+struct SchedThread
+{
+	pthread_t thread;
+	SchedulerPtr scheduler;
+	int worker;
+};
+
+static double now();
+static SchedJobPtr popBottom( struct SchedDeque* deque );
+static void* runWorker( void* arg );
+static int sizedItemCompare( const void* a, const void* b );
+static SchedJobPtr stealTop( struct SchedDeque* deque );
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Take the heaviest waiting job from the owner's end of the deque.
+ *
+ * Return the job, or NULL if the deque is empty.
+ */
+static SchedJobPtr popBottom( struct SchedDeque* deque )
+{
+	SchedJobPtr job = NULL;
+
+	pthread_mutex_lock( &deque->lock );
+	if( deque->bottom > deque->top )
+	{
+		job = deque->jobs[--deque->bottom];
+	}
+	pthread_mutex_unlock( &deque->lock );
+
+	return job;
+}
+
+/**
+ * Take the lightest waiting job from the thieves' end of the deque.
+ *
+ * Return the job, or NULL if the deque is empty.
+ */
+static SchedJobPtr stealTop( struct SchedDeque* deque )
+{
+	SchedJobPtr job = NULL;
+
+	pthread_mutex_lock( &deque->lock );
+	if( deque->bottom > deque->top )
+	{
+		job = deque->jobs[deque->top++];
+	}
+	pthread_mutex_unlock( &deque->lock );
+
+	return job;
+}
+
+/**
+ * Thread entry point: run jobs from this worker's deque, then steal from the
+ * others (starting with the next worker along) until every deque is empty.
+ * Jobs are never added once the run has started, so a full pass over the
+ * deques that finds nothing means the work is done.
+ */
+static void* runWorker( void* arg )
+{
+	struct SchedThread* self = arg;
+	SchedulerPtr scheduler = self->scheduler;
+	struct SchedWorkerStats* stats = &scheduler->stats[self->worker];
+	double start = now();
+
+	while( 1 )
+	{
+		SchedJobPtr job = popBottom( &scheduler->deques[self->worker] );
+		int w;
+
+		for( w = 1; job == NULL && w < scheduler->worker_count; w++ )
+		{
+			job = stealTop( &scheduler->deques[(self->worker + w) % scheduler->worker_count] );
+			if( job != NULL )
+			{
+				stats->steals++;
+			}
+		}
+
+		if( job == NULL )
+		{
+			break;
+		}
+
+		double job_start = now();
+		size_t i;
+
+		for( i = 0; i < job->item_count; i++ )
+		{
+			scheduler->task( scheduler->context, self->worker, job->items[i] );
+		}
+
+		stats->busy_seconds += now() - job_start;
+		stats->jobs++;
+		stats->items += job->item_count;
+		stats->bytes += job->bytes;
+	}
+
+	stats->total_seconds = now() - start;
+
+	return NULL;
+}
+
+/**
+ * qsort comparator ordering items by descending size, then by position.
+ */
+static int sizedItemCompare( const void* a, const void* b )
+{
+	const struct SizedItem* a_item = a;
+	const struct SizedItem* b_item = b;
+
+	if( a_item->size != b_item->size )
+	{
+		return a_item->size > b_item->size ? -1 : 1;
+	}
+
+	return a_item->item < b_item->item ? -1 : ( a_item->item > b_item->item );
+}
+
+SchedulerPtr SchedCreate( size_t* sizes, size_t count, int worker_count )
+{
+	if( worker_count < 1 )
+	{
+		return NULL;
+	}
+
+	SchedulerPtr scheduler = calloc( 1, sizeof(*scheduler) );
+	struct SizedItem* order = malloc( ( count > 0 ? count : 1 ) * sizeof(*order) );
+	size_t i;
+	int w;
+
+	if( scheduler == NULL || order == NULL )
+	{
+		free( scheduler );
+		free( order );
+		return NULL;
+	}
+
+	scheduler->worker_count = worker_count;
+	scheduler->job_items = malloc( ( count > 0 ? count : 1 ) * sizeof(*scheduler->job_items) );
+	scheduler->jobs = malloc( ( count > 0 ? count : 1 ) * sizeof(*scheduler->jobs) );
+	scheduler->deques = calloc( worker_count, sizeof(*scheduler->deques) );
+	scheduler->stats = calloc( worker_count, sizeof(*scheduler->stats) );
+
+	if( scheduler->job_items == NULL || scheduler->jobs == NULL || scheduler->deques == NULL || scheduler->stats == NULL )
+	{
+		free( scheduler->job_items );
+		free( scheduler->jobs );
+		free( scheduler->deques );
+		free( scheduler->stats );
+		free( scheduler );
+		free( order );
+		return NULL;
+	}
+
+	/* The locks are set up first, so that SchedDestroy can undo a scheduler that fails from here on. */
+	for( w = 0; w < worker_count; w++ )
+	{
+		pthread_mutex_init( &scheduler->deques[w].lock, NULL );
+	}
+
+	size_t total_bytes = 0;
+
+	for( i = 0; i < count; i++ )
+	{
+		order[i].size = sizes[i];
+		order[i].item = i;
+		total_bytes += sizes[i];
+	}
+	qsort( order, count, sizeof(*order), sizedItemCompare );
+
+	size_t target_jobs = (size_t)worker_count * SCHED_JOBS_PER_WORKER;
+	size_t batch_bytes = total_bytes / target_jobs;
+	size_t batch_items = count / target_jobs;
+
+	if( batch_bytes > SCHED_BATCH_BYTES || batch_bytes == 0 )
+	{
+		batch_bytes = batch_bytes == 0 ? 1 : SCHED_BATCH_BYTES;
+	}
+	if( batch_items > SCHED_BATCH_ITEMS || batch_items == 0 )
+	{
+		batch_items = batch_items == 0 ? 1 : SCHED_BATCH_ITEMS;
+	}
+
+	/*
+	 * Group the items, largest first.  Anything of at least a batch's worth of
+	 * bytes is a job on its own; the rest are batched.  An empty item still
+	 * costs an open() and some bookkeeping, so batches are also capped by
+	 * count.  Since the items are visited in descending size, the jobs come
+	 * out heaviest first too.
+	 */
+	SchedJobPtr job = NULL;
+
+	for( i = 0; i < count; i++ )
+	{
+		if( job == NULL )
+		{
+			job = &scheduler->jobs[scheduler->job_count++];
+			job->items = &scheduler->job_items[i];
+			job->item_count = 0;
+			job->bytes = 0;
+		}
+
+		scheduler->job_items[i] = order[i].item;
+		job->item_count++;
+		job->bytes += order[i].size;
+
+		if( job->bytes >= batch_bytes || job->item_count >= batch_items )
+		{
+			job = NULL;
+		}
+	}
+
+	free( order );
+
+	/* Deal each job, heaviest first, to the deque with the least work so far. */
+	size_t* owner = malloc( ( scheduler->job_count > 0 ? scheduler->job_count : 1 ) * sizeof(*owner) );
+	size_t* load = calloc( worker_count, sizeof(*load) );
+	size_t* queued = calloc( worker_count, sizeof(*queued) );
+
+	if( owner == NULL || load == NULL || queued == NULL )
+	{
+		free( owner );
+		free( load );
+		free( queued );
+		SchedDestroy( scheduler );
+		return NULL;
+	}
+
+	for( i = 0; i < scheduler->job_count; i++ )
+	{
+		int lightest = 0;
+
+		for( w = 1; w < worker_count; w++ )
+		{
+			if( load[w] < load[lightest] )
+			{
+				lightest = w;
+			}
+		}
+
+		owner[i] = lightest;
+		load[lightest] += scheduler->jobs[i].bytes + 1;
+		queued[lightest]++;
+	}
+
+	for( w = 0; w < worker_count; w++ )
+	{
+		struct SchedDeque* deque = &scheduler->deques[w];
+		deque->jobs = malloc( ( queued[w] > 0 ? queued[w] : 1 ) * sizeof(*deque->jobs) );
+		deque->top = 0;
+		deque->bottom = queued[w];
+
+		if( deque->jobs == NULL )
+		{
+			free( owner );
+			free( load );
+			free( queued );
+			SchedDestroy( scheduler );
+			return NULL;
+		}
+	}
+
+	/*
+	 * Fill each deque from the bottom up, so that the heaviest job sits at the
+	 * bottom, where its owner starts, and the lightest at the top, where thieves
+	 * take from.
+	 */
+	for( i = 0; i < scheduler->job_count; i++ )
+	{
+		w = owner[i];
+		scheduler->deques[w].jobs[--queued[w]] = &scheduler->jobs[i];
+	}
+
+	free( owner );
+	free( load );
+	free( queued );
+
+	return scheduler;
+}
+
+int SchedRun( SchedulerPtr scheduler, SchedTaskFn task, void* context )
+{
+	struct SchedThread* threads = malloc( scheduler->worker_count * sizeof(*threads) );
+	int started = 0;
+	int w;
+
+	if( threads == NULL )
+	{
+		return 0;
+	}
+
+	scheduler->task = task;
+	scheduler->context = context;
+
+	/* Workers that fail to start leave their deques to be stolen by the rest. */
+	for( w = 0; w < scheduler->worker_count; w++ )
+	{
+		threads[started].scheduler = scheduler;
+		threads[started].worker = w;
+
+		if( pthread_create( &threads[started].thread, NULL, runWorker, &threads[started] ) == 0 )
+		{
+			started++;
+		}
+	}
+
+	for( w = 0; w < started; w++ )
+	{
+		pthread_join( threads[w].thread, NULL );
+	}
+
+	free( threads );
+
+	return started;
+}
+
+void SchedPrintStats( SchedulerPtr scheduler, FILE* out )
+{
+	double longest = 0;
+	int w;
+
+	for( w = 0; w < scheduler->worker_count; w++ )
+	{
+		if( scheduler->stats[w].total_seconds > longest )
+		{
+			longest = scheduler->stats[w].total_seconds;
+		}
+	}
+
+	fprintf( out, "%zu jobs over %d workers\n", scheduler->job_count, scheduler->worker_count );
+
+	for( w = 0; w < scheduler->worker_count; w++ )
+	{
+		struct SchedWorkerStats* stats = &scheduler->stats[w];
+
+		/* Utilization is relative to the slowest worker, i.e. to the build's wall time. */
+		fprintf( out, "worker %2d: %6zu jobs %8zu files %10.1f MB %5zu steals  busy %8.3f s (%5.1f%%)\n",
+				w, stats->jobs, stats->items, stats->bytes / (1024.0 * 1024.0), stats->steals,
+				stats->busy_seconds, longest > 0 ? 100.0 * stats->busy_seconds / longest : 0.0 );
+	}
+}
+
+void SchedDestroy( SchedulerPtr scheduler )
+{
+	int w;
+
+	if( scheduler == NULL )
+	{
+		return;
+	}
+
+	for( w = 0; w < scheduler->worker_count; w++ )
+	{
+		pthread_mutex_destroy( &scheduler->deques[w].lock );
+		free( scheduler->deques[w].jobs );
+	}
+
+	free( scheduler->deques );
+	free( scheduler->stats );
+	free( scheduler->jobs );
+	free( scheduler->job_items );
+	free( scheduler );
+}
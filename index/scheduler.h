@@ -0,0 +1,129 @@
+#ifndef index_scheduler_h
+#define index_scheduler_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * scheduler.h
+ *
+ * A work-stealing scheduler for a fixed set of items (files) of known size.
+ * Items are grouped into jobs of roughly even weight: a large item is a job on
+ * its own, and small items are batched together.  Jobs are dealt out to one
+ * deque per worker, heaviest first to the least loaded deque.  Each worker
+ * runs jobs from the bottom of its own deque, heaviest first, and once that is
+ * empty steals the lightest job from the top of another worker's deque.
+ */
+
+/* Small items are batched until a job holds at least this many bytes... */
+#define SCHED_BATCH_BYTES (1024 * 1024)
+
+/* ...or this many items, whichever comes first. */
+#define SCHED_BATCH_ITEMS 256
+
+/*
+ * Batches are made smaller when needed so that there are at least this many
+ * jobs per worker, leaving something to steal on small inputs.
+ */
+#define SCHED_JOBS_PER_WORKER 8
+
+/*
+ * The function run for each item.  worker identifies the calling worker, from
+ * 0 to the number of workers - 1, so that it can use worker-private state.
+ */
+typedef void (*SchedTaskFn)( void* context, int worker, size_t item );
+
+/*
+ * A group of items that is scheduled as a unit.
+ */
+struct SchedJob
+{
+	/* Positions of the job's items in the scheduler's input. */
+	size_t* items;
+	size_t item_count;
+
+	/* The sum of the sizes of the job's items. */
+	size_t bytes;
+};
+typedef struct SchedJob* SchedJobPtr;
+
+/*
+ * A double-ended queue of jobs owned by one worker.  The owner takes jobs from
+ * the bottom and thieves take them from the top; a mutex guards both ends.
+ */
+struct SchedDeque
+{
+	SchedJobPtr* jobs;
+
+	/* Jobs in [top, bottom) are waiting. */
+	size_t top;
+	size_t bottom;
+
+	pthread_mutex_t lock;
+};
+
+/*
+ * Per-worker counters, filled in by SchedRun.
+ */
+struct SchedWorkerStats
+{
+	size_t jobs;
+	size_t items;
+	size_t bytes;
+
+	/* Jobs taken from other workers' deques. */
+	size_t steals;
+
+	/* Seconds spent running items, and seconds from start to finish. */
+	double busy_seconds;
+	double total_seconds;
+};
+
+struct Scheduler
+{
+	int worker_count;
+
+	SchedJobPtr jobs;
+	size_t job_count;
+
+	/* Backing storage for every job's items. */
+	size_t* job_items;
+
+	struct SchedDeque* deques;
+	struct SchedWorkerStats* stats;
+
+	SchedTaskFn task;
+	void* context;
+};
+typedef struct Scheduler* SchedulerPtr;
+
+/*
+ * SchedCreate groups count items, whose sizes in bytes are given, into jobs
+ * and deals them out among worker_count deques.
+ *
+ * If the function succeeds, it returns a non-NULL SchedulerPtr.
+ * Else it returns NULL.
+ */
+SchedulerPtr SchedCreate( size_t* sizes, size_t count, int worker_count );
+
+/*
+ * SchedRun starts one thread per worker and calls task for every item, then
+ * waits for all of them to finish.  A scheduler can only be run once.
+ *
+ * Returns the number of workers that ran; 0 means no thread could be
+ * started and no item was run.
+ */
+int SchedRun( SchedulerPtr scheduler, SchedTaskFn task, void* context );
+
+/*
+ * SchedPrintStats writes a line of utilization figures per worker to out.
+ */
+void SchedPrintStats( SchedulerPtr scheduler, FILE* out );
+
+/*
+ * SchedDestroy frees the scheduler and all memory associated with it.
+ */
+void SchedDestroy( SchedulerPtr scheduler );
+
+#endif
@@ -189,11 +189,13 @@ void SLDestroy(SortedListPtr list)
 	Node curr = list->head;
 	Node temp = NULL;
 	
+	//The whole chain is going away, so the nodes are freed directly rather than
+	//through deleteNode, which would touch the already-freed previous node.
 	while( curr != NULL )
 	{
 		temp = curr;
 		curr = curr->next;
-		deleteNode(temp);
+		free(temp);
 	}
 	
 	free( list );
@@ -460,7 +462,15 @@ void primeNodeForRemoval( SortedListPtr list, Node node )
  */
 void shiftNodeUp( SortedListPtr list, void* target )
 {
-	Node target_node = findNode( list, target );
+	//The target has changed, so its node can no longer be found by comparison
+	//(findNode stops early once it passes where the target now belongs).
+	//Find it by identity instead.
+	Node target_node = list->head;
+	while( target_node != NULL && target_node->object != target )
+	{
+		target_node = target_node->next;
+	}
+
 	if( target_node == NULL )
 	{
 		return;
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <string.h>
+#include "scheduler.h"
+#include "string-sort.h"
+
+/*
+ * The buckets left after the parallel first pass, shared by the threads that sort them.
+ */
+struct BucketSort
+{
+	struct SSItem* items;
+	struct SSItem* scratch;
+
+	/* Where each bucket starts in items (and scratch), and how many items it holds. */
+	size_t* starts;
+	size_t* counts;
+};
+
+static int descendingCompare( const void* a, const void* b );
+static void insertionSort( struct SSItem* items, size_t count, size_t depth );
+static void msdSort( struct SSItem* items, struct SSItem* scratch, size_t count, size_t depth );
+static void sortBucketTask( void* sort, int worker, size_t bucket );
+static int sortParallel( struct SSItem* items, struct SSItem* scratch, size_t count, int threads );
+
+/**
+ * qsort comparator putting an array of items in descending strcmp order of string.
+ */
+static int descendingCompare( const void* a, const void* b )
+{
+	return strcmp( ( (const struct SSItem*)b )->string, ( (const struct SSItem*)a )->string );
+}
+
+/**
+ * Sort items whose strings all share their first depth bytes.
+ */
+static void insertionSort( struct SSItem* items, size_t count, size_t depth )
+{
+	size_t i;
+
+	for( i = 1; i < count; i++ )
+	{
+		struct SSItem item = items[i];
+		size_t j = i;
+
+		while( j > 0 && strcmp( item.string + depth, items[j - 1].string + depth ) > 0 )
+		{
+			items[j] = items[j - 1];
+			j--;
+		}
+
+		items[j] = item;
+	}
+}
+
+/**
+ * Sort items whose strings all share their first depth bytes, by distributing
+ * them on the byte at depth and then sorting each bucket on the byte after.
+ * scratch must hold count items.
+ */
+static void msdSort( struct SSItem* items, struct SSItem* scratch, size_t count, size_t depth )
+{
+	size_t counts[256];
+	size_t next[256];
+	size_t i;
+	int c;
+
+	while( 1 )
+	{
+		if( count < SS_INSERTION_SORT_MAX )
+		{
+			insertionSort( items, count, depth );
+			return;
+		}
+
+		if( depth >= SS_MAX_DEPTH )
+		{
+			qsort( items, count, sizeof(*items), descendingCompare );
+			return;
+		}
+
+		memset( counts, 0, sizeof(counts) );
+
+		for( i = 0; i < count; i++ )
+		{
+			counts[(unsigned char)items[i].string[depth]]++;
+		}
+
+		/* If every string has the same byte here, move on to the next byte without distributing. */
+		c = (unsigned char)items[0].string[depth];
+
+		if( counts[c] != count )
+		{
+			break;
+		}
+
+		/* Strings that all end here are equal. */
+		if( c == 0 )
+		{
+			return;
+		}
+
+		depth++;
+	}
+
+	/* Buckets are laid out from the highest byte down; the strings that end here come last. */
+	size_t position = 0;
+
+	for( c = 255; c >= 0; c-- )
+	{
+		next[c] = position;
+		position += counts[c];
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		scratch[next[(unsigned char)items[i].string[depth]]++] = items[i];
+	}
+
+	memcpy( items, scratch, count * sizeof(*items) );
+
+	/* next[c] is now the end of bucket c. */
+	for( c = 255; c > 0; c-- )
+	{
+		if( counts[c] > 1 )
+		{
+			size_t start = next[c] - counts[c];
+			msdSort( items + start, scratch + start, counts[c], depth + 1 );
+		}
+	}
+}
+
+/**
+ * Scheduler task for a parallel sort: sort one bucket left by the first pass.
+ */
+static void sortBucketTask( void* sort, int worker, size_t bucket )
+{
+	struct BucketSort* self = sort;
+	size_t start = self->starts[bucket];
+
+	msdSort( self->items + start, self->scratch + start, self->counts[bucket], 2 );
+}
+
+/**
+ * Distribute the strings on their first two bytes at once, into 65536
+ * buckets, then sort the buckets on threads threads.
+ *
+ * Return 1 if the items were sorted, 0 if memory could not be allocated.
+ */
+static int sortParallel( struct SSItem* items, struct SSItem* scratch, size_t count, int threads )
+{
+	size_t* next = calloc( 65536, sizeof(*next) );
+	size_t* starts = malloc( 65536 * sizeof(*starts) );
+	size_t* counts = malloc( 65536 * sizeof(*counts) );
+	size_t i;
+	int key;
+
+	if( next == NULL || starts == NULL || counts == NULL )
+	{
+		free( next );
+		free( starts );
+		free( counts );
+		return 0;
+	}
+
+	/*
+	 * A string's key is its first two bytes, with the second taken as 0 when
+	 * the string is empty, so that descending keys are in descending strcmp
+	 * order and a key ending in 0 holds strings that are all equal.
+	 */
+	for( i = 0; i < count; i++ )
+	{
+		unsigned char first = items[i].string[0];
+		next[first << 8 | ( first != 0 ? (unsigned char)items[i].string[1] : 0 )]++;
+	}
+
+	size_t position = 0;
+	size_t buckets = 0;
+
+	for( key = 65535; key >= 0; key-- )
+	{
+		size_t size = next[key];
+
+		/* Only buckets of more than one string that has not yet ended still need sorting. */
+		if( size > 1 && ( key & 0xFF ) != 0 )
+		{
+			starts[buckets] = position;
+			counts[buckets] = size;
+			buckets++;
+		}
+
+		next[key] = position;
+		position += size;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		unsigned char first = items[i].string[0];
+		scratch[next[first << 8 | ( first != 0 ? (unsigned char)items[i].string[1] : 0 )]++] = items[i];
+	}
+
+	memcpy( items, scratch, count * sizeof(*items) );
+	free( next );
+
+	struct BucketSort sort;
+	sort.items = items;
+	sort.scratch = scratch;
+	sort.starts = starts;
+	sort.counts = counts;
+
+	SchedulerPtr scheduler = SchedCreate( counts, buckets, threads );
+
+	/* If no thread could be started, sort the buckets on this one. */
+	if( scheduler == NULL || SchedRun( scheduler, sortBucketTask, &sort ) == 0 )
+	{
+		for( i = 0; i < buckets; i++ )
+		{
+			sortBucketTask( &sort, 0, i );
+		}
+	}
+
+	SchedDestroy( scheduler );
+	free( starts );
+	free( counts );
+
+	return 1;
+}
+
+void SSSort( struct SSItem* items, size_t count, int threads )
+{
+	if( count < 2 )
+	{
+		return;
+	}
+
+	struct SSItem* scratch = malloc( count * sizeof(*scratch) );
+
+	if( scratch == NULL )
+	{
+		qsort( items, count, sizeof(*items), descendingCompare );
+		return;
+	}
+
+	if( threads <= 1 || count < SS_PARALLEL_MIN || !sortParallel( items, scratch, count, threads ) )
+	{
+		msdSort( items, scratch, count, 0 );
+	}
+
+	free( scratch );
+}
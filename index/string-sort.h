@@ -0,0 +1,45 @@
+#ifndef index_string_sort_h
+#define index_string_sort_h
+
+#include <stddef.h>
+
+/*
+ * string-sort.h
+ *
+ * An MSD radix sort for arrays of null-terminated strings, ordering them by
+ * descending strcmp.  Each string is sorted together with a value, so callers
+ * need not look up what a string belongs to once it is in order.  Strings are distributed byte by byte into 256 buckets
+ * each step, so every byte of a string is looked at a bounded number of times
+ * rather than once per comparison.
+ *
+ * With more than one thread, the first two bytes are distributed in a single
+ * pass and the resulting buckets, which are independent, are sorted in
+ * parallel by the work-stealing scheduler.
+ */
+
+/* Buckets smaller than this are finished by insertion sort. */
+#define SS_INSERTION_SORT_MAX 32
+
+/* Buckets still unsorted this many bytes in are finished by qsort, bounding the recursion. */
+#define SS_MAX_DEPTH 256
+
+/* Arrays smaller than this are always sorted on the calling thread. */
+#define SS_PARALLEL_MIN 65536
+
+/* A string to be sorted, and the value that moves with it. */
+struct SSItem
+{
+	char* string;
+	void* value;
+};
+
+/*
+ * SSSort sorts the count items of items into descending strcmp order of their
+ * strings, using up to threads threads.  The strings themselves are not moved
+ * or copied, only the items pointing to them.
+ *
+ * If memory for the sort cannot be allocated, the items are sorted by qsort instead.
+ */
+void SSSort( struct SSItem* items, size_t count, int threads );
+
+#endif
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include "term-counts.h"
+
+static TermCountPtr newEntry( TermCountsPtr counts );
+
+/**
+ * Take an unused entry from the table's blocks, adding a block if all are full.
+ *
+ * Return the entry, or NULL if no memory could be allocated.
+ */
+static TermCountPtr newEntry( TermCountsPtr counts )
+{
+	struct TermCountBlock* block = counts->current_block;
+
+	if( block == NULL || block->used == TC_BLOCK_ENTRIES )
+	{
+		/* Reuse the next block kept from before the last TCClear, if there is one. */
+		struct TermCountBlock* next = block != NULL ? block->next : counts->first_block;
+
+		if( next == NULL )
+		{
+			next = malloc( sizeof(*next) );
+
+			if( next == NULL )
+			{
+				return NULL;
+			}
+
+			next->next = NULL;
+			if( block != NULL )
+			{
+				block->next = next;
+			}
+			else
+			{
+				counts->first_block = next;
+			}
+		}
+
+		next->used = 0;
+		counts->current_block = next;
+		block = next;
+	}
+
+	return &block->entries[block->used++];
+}
+
+TermCountsPtr TCCreate()
+{
+	TermCountsPtr counts = malloc( sizeof(*counts) );
+
+	if( counts == NULL )
+	{
+		return NULL;
+	}
+
+	counts->table = HTCreate();
+
+	if( counts->table == NULL )
+	{
+		free( counts );
+		return NULL;
+	}
+
+	counts->tokens = 0;
+	counts->first_block = NULL;
+	counts->current_block = NULL;
+
+	return counts;
+}
+
+int TCAdd( TermCountsPtr counts, uint64_t hash, char* term, size_t term_length, size_t count )
+{
+	void** value = HTPut( counts->table, hash, term, term_length );
+
+	if( value == NULL )
+	{
+		return 0;
+	}
+
+	TermCountPtr entry = *value;
+
+	if( entry == NULL )
+	{
+		entry = newEntry( counts );
+
+		if( entry == NULL )
+		{
+			HTRemove( counts->table, hash, term, term_length );
+			return 0;
+		}
+
+		entry->term = term;
+		entry->term_length = term_length;
+		entry->count = 0;
+		*value = entry;
+	}
+
+	entry->count += count;
+	counts->tokens += count;
+
+	return 1;
+}
+
+int TCMerge( TermCountsPtr dest, TermCountsPtr src )
+{
+	size_t position = 0;
+	HashSlotPtr slot;
+
+	while( ( slot = HTNext( src->table, &position ) ) != NULL )
+	{
+		TermCountPtr entry = slot->value;
+
+		if( !TCAdd( dest, slot->hash, entry->term, entry->term_length, entry->count ) )
+		{
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+void TCClear( TermCountsPtr counts )
+{
+	HashTablePtr table = counts->table;
+
+	if( table->capacity > TC_SHRINK_CAPACITY && table->count < table->capacity / TC_SHRINK_RATIO )
+	{
+		HashTablePtr small = HTCreate();
+
+		if( small != NULL )
+		{
+			HTDestroy( table );
+			counts->table = small;
+			table = NULL;
+		}
+	}
+
+	if( table != NULL )
+	{
+		HTClear( table );
+	}
+
+	counts->tokens = 0;
+	counts->current_block = NULL;
+}
+
+void TCDestroy( TermCountsPtr counts )
+{
+	if( counts == NULL )
+	{
+		return;
+	}
+
+	HTDestroy( counts->table );
+
+	struct TermCountBlock* block = counts->first_block;
+
+	while( block != NULL )
+	{
+		struct TermCountBlock* next = block->next;
+		free( block );
+		block = next;
+	}
+
+	free( counts );
+}
@@ -0,0 +1,99 @@
+#ifndef index_term_counts_h
+#define index_term_counts_h
+
+#include <stddef.h>
+#include "hash-table.h"
+
+/*
+ * term-counts.h
+ *
+ * A small hash table counting the occurrences of each distinct token in one
+ * file.  Tokens are counted here first, and are only merged into the index
+ * once per distinct term after the whole file has been read.
+ *
+ * Terms are NOT copied: each entry points into the buffer the token was read
+ * from, which must outlive the table (or at least the next TCClear).
+ */
+
+/* The number of entries allocated at once; entries are never freed singly. */
+#define TC_BLOCK_ENTRIES 1024
+
+/*
+ * TCClear replaces a table of more than TC_SHRINK_CAPACITY slots with a new,
+ * small one when fewer than one slot in TC_SHRINK_RATIO was used, so that
+ * files after a very large one do not pay to clear and walk all its slots.
+ */
+#define TC_SHRINK_CAPACITY 4096
+#define TC_SHRINK_RATIO 8
+
+struct TermCount
+{
+	/* A view of the term in the tokenized buffer; NOT null-terminated. */
+	char* term;
+	size_t term_length;
+
+	/* The number of times the term occurs. */
+	size_t count;
+};
+typedef struct TermCount* TermCountPtr;
+
+/*
+ * A block of entries.  Blocks are kept across TCClear, so a table that is
+ * reused from file to file stops allocating once it has seen its largest file.
+ */
+struct TermCountBlock
+{
+	struct TermCountBlock* next;
+	size_t used;
+	struct TermCount entries[TC_BLOCK_ENTRIES];
+};
+
+struct TermCounts
+{
+	/* The hash table of entries, keyed on the term's bytes. */
+	HashTablePtr table;
+
+	/* The total number of tokens counted. */
+	size_t tokens;
+
+	/* The first block, and the block entries are currently taken from. */
+	struct TermCountBlock* first_block;
+	struct TermCountBlock* current_block;
+};
+typedef struct TermCounts* TermCountsPtr;
+
+/*
+ * TCCreate creates a new, empty table.
+ *
+ * If the function succeeds, it returns a non-NULL TermCountsPtr.
+ * Else it returns NULL.
+ */
+TermCountsPtr TCCreate();
+
+/*
+ * TCAdd adds count occurrences of the term_length bytes at term, whose hash
+ * (see hash.h) is hash.  The hash is kept with the entry for later lookups.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int TCAdd( TermCountsPtr counts, uint64_t hash, char* term, size_t term_length, size_t count );
+
+/*
+ * TCMerge adds every count of src to dest.  src is left unchanged.
+ *
+ * If the function succeeds, it returns 1.  Else, it returns 0.
+ */
+int TCMerge( TermCountsPtr dest, TermCountsPtr src );
+
+/*
+ * TCClear empties the table, keeping its memory for reuse unless the table
+ * has grown far beyond what it held (see TC_SHRINK_CAPACITY).
+ */
+void TCClear( TermCountsPtr counts );
+
+/*
+ * TCDestroy destroys the table, freeing all dynamically allocated memory.
+ */
+void TCDestroy( TermCountsPtr counts );
+
+#endif
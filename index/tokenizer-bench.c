@@ -0,0 +1,114 @@
+/*
+ * tokenizer-bench.c
+ *
+ * Measures tokenizer throughput over synthetic inputs of increasing size.
+ * A linear-time tokenizer reports roughly the same MB/s for every size.
+ * The last set of runs also hashes every token, as the indexer does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "char-class.h"
+#include "tokenizer.h"
+
+#define BENCH_MIN_SIZE (1 << 20)
+#define BENCH_MAX_SIZE (64 << 20)
+
+static volatile uint64_t hash_sink;
+
+/*
+ * Fill buffer with size bytes of words and assorted delimiters, including
+ * the odd null byte, so that the tokenizer sees a realistic mix.
+ */
+static void fillBuffer( char* buffer, size_t size )
+{
+	static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+	static const char delimiters[] = " \n\t.,;:-()\"'";
+	unsigned int seed = 214;
+	size_t i = 0;
+
+	while( i < size )
+	{
+		size_t word_length = 1 + rand_r( &seed ) % 12;
+
+		while( word_length-- > 0 && i < size )
+		{
+			buffer[i++] = alphabet[rand_r( &seed ) % (sizeof(alphabet) - 1)];
+		}
+
+		if( i < size )
+		{
+			int choice = rand_r( &seed ) % 64;
+			buffer[i++] = choice == 0 ? '\0' : delimiters[choice % (sizeof(delimiters) - 1)];
+		}
+	}
+}
+
+static double elapsedSeconds( struct timespec* start, struct timespec* end )
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main( int argc, char** argv )
+{
+	char* buffer = malloc( BENCH_MAX_SIZE );
+
+	if( buffer == NULL )
+	{
+		printf("ERROR: Unable to allocate benchmark buffer\n");
+		return EXIT_FAILURE;
+	}
+
+	fillBuffer( buffer, BENCH_MAX_SIZE );
+
+	printf("scan kernel: %s\n", CCKernelName());
+	printf("%9s %12s %12s %10s %10s\n", "escapes", "bytes", "tokens", "seconds", "MB/s");
+
+	static const TKEscapeMode modes[] = { TK_ESCAPES_ON, TK_ESCAPES_AUTO, TK_ESCAPES_AUTO };
+	static const int hashed[] = { 0, 0, 1 };
+	static const char* mode_names[] = { "on", "auto", "auto+hash" };
+	size_t size;
+	int mode;
+
+	for( mode = 0; mode < 3; mode++ )
+	for( size = BENCH_MIN_SIZE; size <= BENCH_MAX_SIZE; size *= 2 )
+	{
+		struct timespec start, end;
+		size_t tokens = 0;
+		size_t length = 0;
+		uint64_t hash = 0;
+		uint64_t hash_sum = 0;
+
+		clock_gettime( CLOCK_MONOTONIC, &start );
+
+		TokenizerT* tk = TKCreate( buffer, size, modes[mode] );
+		if( hashed[mode] )
+		{
+			/* The hashes are summed into hash_sink so that computing them cannot be optimized away. */
+			while( TKGetNextTokenHashed( tk, &length, &hash ) != NULL )
+			{
+				tokens++;
+				hash_sum += hash;
+			}
+		}
+		else
+		{
+			while( TKGetNextTokenView( tk, &length ) != NULL )
+			{
+				tokens++;
+			}
+		}
+		TKDestroy( tk );
+		hash_sink += hash_sum;
+
+		clock_gettime( CLOCK_MONOTONIC, &end );
+
+		double seconds = elapsedSeconds( &start, &end );
+		printf("%9s %12zu %12zu %10.4f %10.1f\n", mode_names[mode], size, tokens, seconds, size / seconds / (1 << 20));
+	}
+
+	free( buffer );
+
+	return 0;
+}
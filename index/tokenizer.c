@@ -5,6 +5,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include "char-class.h"
+#include "hash.h"
 #include "tokenizer.h"
 
 #define MAX_HEX_CHARS 2
@@ -83,29 +85,33 @@ int is_oct_digit(char oct_digit) {
 }
 
 
-char* unescape_string(char* string) {
+char* unescape_string(char* string, size_t length, size_t* unescaped_length) {
 	
 	/*
 	 * Description: given an input stream converts escaped characters into their appropriate char representation and returns it as a new string
-	 * Parameters: string to be converted
-	 * Modifies: nothing
-	 * Returns: resulting string with all the escaped characters with their appropriate values
+	 * Parameters: string to be converted, number of bytes in string (string need not be null-terminated), location in which to store the length of the result
+	 * Modifies: *unescaped_length: set to the number of bytes in the result, which may include embedded null bytes
+	 * Returns: resulting null-terminated string with all the escaped characters with their appropriate values
 	 *
 	 */
 	
-	char* unescaped_string = (char*)malloc(strlen(string) * sizeof(char) + 1);
-	int current_position = 0;
-	int unescaped_string_position = 0;
+	char* unescaped_string = (char*)malloc(length * sizeof(char) + 1);
+	size_t current_position = 0;
+	size_t unescaped_string_position = 0;
 	unsigned char escape_character = 0;
 	
-	for(current_position = 0; current_position < strlen(string); current_position++) {
+	if(unescaped_string == NULL) {
+		return NULL;
+	}
+	
+	for(current_position = 0; current_position < length; current_position++) {
 		escape_character = *(string + current_position);
-		if(*(string + current_position) == '\\') {
+		if(*(string + current_position) == '\\' && current_position + 1 < length) {
 			if(*(string + current_position + 1) == 'x') {
 				current_position++;
 				int hex_count;
 				escape_character = 0;
-				for(hex_count = 1; hex_count <= MAX_HEX_CHARS; hex_count++) {
+				for(hex_count = 1; hex_count <= MAX_HEX_CHARS && current_position + hex_count < length; hex_count++) {
 					if(!isxdigit(*(string + current_position + hex_count))) {
 						break;
 					}
@@ -116,13 +122,13 @@ char* unescape_string(char* string) {
 			} else if(is_oct_digit((*(string + current_position + 1))) == 1) {
 				int oct_count;
 				escape_character = 0;
-				for(oct_count = 1; oct_count <= MAX_OCT_CHARS; oct_count++) {
+				for(oct_count = 1; oct_count <= MAX_OCT_CHARS && current_position + oct_count < length; oct_count++) {
 					if(is_oct_digit(*(string + current_position + oct_count)) == 0) {
 						break;
 					}
 					escape_character = escape_character * 8 + char_to_oct(*(string + current_position + oct_count));
 				}
-				current_position += oct_count;
+				current_position += oct_count - 1;
 			} else {
 				escape_character = is_escape_character(*(string + current_position + 1));
 				
@@ -138,7 +144,8 @@ char* unescape_string(char* string) {
 		escape_character = 0;
 	}
 	
-	*(unescaped_string + unescaped_string_position + 1) = '\0';
+	*(unescaped_string + unescaped_string_position) = '\0';
+	*unescaped_length = unescaped_string_position;
 	
 	return unescaped_string;
 }
@@ -150,9 +157,11 @@ char* unescape_string(char* string) {
  * TKCreate creates a new TokenizerT object for a given set of separator
  * characters (given as a string) and a token stream (given as a string).
  *
- * TKCreate should copy the two arguments so that it is not dependent on
- * them staying immutable after returning.  (In the future, this may change
- * to increase efficiency.)
+ * The stream is given with an explicit size, so it may be a read-only view
+ * (e.g. a mapped file) that is not null-terminated.  When escape sequences are
+ * decoded, TKCreate tokenizes a private copy of the stream.  Otherwise it
+ * tokenizes the caller's buffer in place, which must then outlive the tokenizer.
+ * In TK_ESCAPES_AUTO mode a single memchr for '\\' decides which applies.
  *
  * If the function succeeds, it returns a non-NULL TokenizerT.
  * Else it returns NULL.
@@ -160,11 +169,11 @@ char* unescape_string(char* string) {
  * You need to fill in this function as part of your implementation.
  */
 
-TokenizerT *TKCreate(char *ts) {
+TokenizerT *TKCreate(char *ts, size_t size, TKEscapeMode escapes) {
 	
 	/*
 	 * Description: creates a new tokenizer struct from the token stream and delimiters
-	 * Parameters: set of delimiters, token stream
+	 * Parameters: token stream, number of bytes in the token stream (the stream need not be null-terminated), escape handling mode
 	 * Modifies: nothing
 	 * Returns: a pointer to a tokenizer struct on success, a null pointer on failure
 	 *
@@ -176,7 +185,27 @@ TokenizerT *TKCreate(char *ts) {
 		return NULL;
 	}
 	
-	tokenizer->copied_string = unescape_string(ts);
+	if(escapes == TK_ESCAPES_AUTO) {
+		escapes = (size > 0 && memchr(ts, '\\', size) != NULL) ? TK_ESCAPES_ON : TK_ESCAPES_OFF;
+	}
+	
+	if(escapes == TK_ESCAPES_ON) {
+		size_t copied_length = 0;
+		tokenizer->copied_string = unescape_string(ts, size, &copied_length);
+		
+		if(tokenizer->copied_string == NULL) {
+			free(tokenizer);
+			return NULL;
+		}
+		
+		tokenizer->end = tokenizer->copied_string + copied_length;
+		tokenizer->owns_string = 1;
+	} else {
+		tokenizer->copied_string = ts;
+		tokenizer->end = ts + size;
+		tokenizer->owns_string = 0;
+	}
+	
 	tokenizer->current_position = tokenizer->copied_string;
 	
 	return tokenizer;
@@ -198,7 +227,9 @@ void TKDestroy(TokenizerT *tk) {
 	 * Returns: nothing
 	 */
 	
-	free(tk->copied_string);
+	if(tk->owns_string) {
+		free(tk->copied_string);
+	}
 	free(tk);
 	
 	return;
@@ -214,13 +245,116 @@ char is_delimiter(char character) {
 	 * Returns: 1 if character is a delimiter, 0 if it is not
 	 */
 	
-	if (!isalnum(character)) {
-		return 1;
+	return !token_class[(unsigned char)character];
+}
+
+
+/*
+ * TKGetNextTokenView returns the next token from the token stream as a view
+ * into the tokenizer's own buffer.  No memory is allocated; the view is NOT
+ * terminated by '\0' and remains valid until the tokenizer is destroyed.
+ *
+ * If the function succeeds, it returns a pointer to the first character of
+ * the token and stores the token's length in *length.  Else it returns 0.
+ */
+
+char *TKGetNextTokenView(TokenizerT *tk, size_t *length) {
+	
+	/*
+	 * Description: returns the next token from the token stream specified within the tokenizer as a view into its buffer
+	 * Parameters: tokenizer from which to extract token, location in which to store the length of the token
+	 * Modifies: tokenizer->current_position: identifies starting point of next token; *length: set to the token's length
+	 * Returns: pointer to the start of the token on success, null on failure/end of string;
+	 */
+	
+	char* end = tk->end;
+	char* token_start = CCScanToToken(tk->current_position, end);
+	
+	if(token_start == end) {
+		tk->current_position = end;
+		return NULL;
 	}
 	
-	return 0;
+	tk->current_position = CCScanToDelimiter(token_start, end);
+	*length = tk->current_position - token_start;
+	return token_start;
 }
 
+/*
+ * TKGetNextTokenHashed returns the next token from the token stream as a
+ * view, like TKGetNextTokenView, and also its hash (see hash.h).  The token
+ * is scanned eight bytes at a time, and each word is folded into the hash as
+ * soon as it is classified, so the token's bytes are read only once.
+ *
+ * If the function succeeds, it returns a pointer to the first character of
+ * the token and stores the token's length in *length and its hash in *hash.
+ * Else it returns 0.
+ */
+
+char *TKGetNextTokenHashed(TokenizerT *tk, size_t *length, uint64_t *hash) {
+	
+	/*
+	 * Description: returns the next token from the token stream as a view into its buffer, along with the token's hash
+	 * Parameters: tokenizer from which to extract token, locations in which to store the length and the hash of the token
+	 * Modifies: tokenizer->current_position: identifies starting point of next token; *length, *hash: set to the token's length and hash
+	 * Returns: pointer to the start of the token on success, null on failure/end of string;
+	 */
+	
+	char* end = tk->end;
+	char* token_start = CCScanToToken(tk->current_position, end);
+	
+	if(token_start == end) {
+		tk->current_position = end;
+		return NULL;
+	}
+	
+	/*
+	 * The byte at position is always a token character.  A whole word of the
+	 * token is only folded in once the token is known to go on past it,
+	 * because HashBytes hashes the last 1 to 8 bytes as the tail.
+	 */
+	char* position = token_start;
+	uint64_t h = HASH_SEED;
+	uint64_t tail = 0;
+	int finished = 0;
+	
+	while(!finished && end - position >= 8) {
+		uint64_t word;
+		memcpy(&word, position, 8);
+		uint64_t delimiters = ~CCTokenMask(word) & 0x8080808080808080ULL;
+		
+		if(delimiters != 0) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+			size_t bytes = __builtin_clzll(delimiters) >> 3;
+#else
+			size_t bytes = __builtin_ctzll(delimiters) >> 3;
+#endif
+			tail = word & HashTailMask(bytes);
+			position += bytes;
+			finished = 1;
+		}
+		else if(end - position == 8 || is_delimiter(position[8])) {
+			tail = word;
+			position += 8;
+			finished = 1;
+		}
+		else {
+			h = HashMix(h ^ word, HASH_MULTIPLIER);
+			position += 8;
+		}
+	}
+	
+	if(!finished) {
+		char* stop = CCScanToDelimiter(position, end);
+		tail = HashTail(position, stop - position);
+		position = stop;
+	}
+	
+	tk->current_position = position;
+	*length = position - token_start;
+	*hash = HashFinish(h, tail, *length);
+	return token_start;
+}
 
 /*
  * TKGetNextToken returns the next token from the token stream as a
@@ -230,8 +364,6 @@ char is_delimiter(char character) {
  *
  * If the function succeeds, it returns a C string (delimited by '\0')
  * containing the token.  Else it returns 0.
- *
- * You need to fill in this function as part of your implementation.
  */
 
 char *TKGetNextToken(TokenizerT *tk) {
@@ -239,36 +371,25 @@ char *TKGetNextToken(TokenizerT *tk) {
 	/*
 	 * Description: returns the next token from the token stream specified within the tokenizer
 	 * Parameters: tokenizer from which to extract token
-	 * Modifies: tokenizer->current_position: identifies starting point of next token; creates a new string with
+	 * Modifies: tokenizer->current_position: identifies starting point of next token; creates a new string with the token's contents
 	 * Returns: token extracted as a char* on success, null on failure/end of string;
 	 */
 	
-	char* token = NULL;
-	char* token_start = NULL;
-	
-	while(tk->current_position - tk->copied_string < strlen(tk->copied_string)) {
-		if(!is_delimiter(*tk->current_position)) {
-			
-			token_start = tk->current_position;
-			break;
-		}
-		tk->current_position++;
-	}
+	size_t length = 0;
+	char* token_start = TKGetNextTokenView(tk, &length);
 	
 	if(token_start == NULL) {
 		return NULL;
 	}
 	
-	while(tk->current_position - tk->copied_string < strlen(tk->copied_string)) {
-		if(is_delimiter(*tk->current_position)) {
-			break;
-		}
-		tk->current_position++;
+	char* token = (char*)malloc(sizeof(char) * (length + 1));
+	
+	if(token == NULL) {
+		return NULL;
 	}
 	
-	token = (char*)malloc(sizeof(char) * (tk->current_position - tk->copied_string + 1));
-	strncpy(token, token_start, tk->current_position - token_start);
-	token[(tk->current_position - tk->copied_string)] = '\0';
+	memcpy(token, token_start, length);
+	token[length] = '\0';
 	return token;
 }
 
@@ -287,7 +408,7 @@ char *TKGetNextToken(TokenizerT *tk) {
  return -1;
  }
  
- TokenizerT* tokenizer = TKCreate(argv[1]);
+ TokenizerT* tokenizer = TKCreate(argv[1], strlen(argv[1]), TK_ESCAPES_ON);
  
  if(tokenizer == NULL) {
  printf("Error: unable to create tokenizer\n");
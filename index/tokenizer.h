@@ -9,9 +9,30 @@
 #ifndef index_tokenizer_h
 #define index_tokenizer_h
 
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * How TKCreate treats backslash escape sequences in the token stream.
+ *   TK_ESCAPES_OFF:  the stream is tokenized as-is, without being copied.
+ *   TK_ESCAPES_ON:   the stream is always decoded into a private copy.
+ *   TK_ESCAPES_AUTO: the stream is decoded only if it contains a backslash.
+ */
+enum TKEscapeMode {
+	TK_ESCAPES_OFF,
+	TK_ESCAPES_ON,
+	TK_ESCAPES_AUTO
+};
+typedef enum TKEscapeMode TKEscapeMode;
+
 struct TokenizerT_ {
+	/* The stream being tokenized: either the caller's buffer or a decoded copy of it. */
 	char* copied_string;
 	char* current_position;
+	/* One past the last byte of copied_string; the stream may contain null bytes. */
+	char* end;
+	/* 1 if copied_string was allocated by TKCreate and must be freed, 0 if it is the caller's. */
+	int owns_string;
 };
 typedef struct TokenizerT_ TokenizerT;
 
@@ -53,21 +74,21 @@ int is_oct_digit(char oct_digit);
 
 /*
  * Description: given an input stream converts escaped characters into their appropriate char representation and returns it as a new string
- * Parameters: string to be converted
- * Modifies: nothing
- * Returns: resulting string with all the escaped characters with their appropriate values
+ * Parameters: string to be converted, number of bytes in string (string need not be null-terminated), location in which to store the length of the result
+ * Modifies: *unescaped_length: set to the number of bytes in the result, which may include embedded null bytes
+ * Returns: resulting null-terminated string with all the escaped characters with their appropriate values
  *
  */
-char* unescape_string(char* string);
+char* unescape_string(char* string, size_t length, size_t* unescaped_length);
 
 /*
  * Description: creates a new tokenizer struct from the token stream and delimiters
- * Parameters: set of delimiters, token stream
+ * Parameters: token stream, number of bytes in the token stream (the stream need not be null-terminated), escape handling mode
  * Modifies: nothing
  * Returns: a pointer to a tokenizer struct on success, a null pointer on failure
  *
  */
-TokenizerT *TKCreate(char *ts);
+TokenizerT *TKCreate(char *ts, size_t size, TKEscapeMode escapes);
 
 /*
  * Description: destroys tokenizer struct and deallocates all memory
@@ -88,8 +109,24 @@ char is_delimiter(char character);
 /*
  * Description: returns the next token from the token stream specified within the tokenizer
  * Parameters: tokenizer from which to extract token
- * Modifies: tokenizer->current_position: identifies starting point of next token; creates a new string with
+ * Modifies: tokenizer->current_position: identifies starting point of next token; creates a new string with the token's contents
  * Returns: token extracted as a char* on success, null on failure/end of string;
  */
 char *TKGetNextToken(TokenizerT *tk);
+
+/*
+ * Description: returns the next token from the token stream as a view into the tokenizer's buffer, without allocating
+ * Parameters: tokenizer from which to extract token, location in which to store the length of the token
+ * Modifies: tokenizer->current_position: identifies starting point of next token; *length: set to the token's length
+ * Returns: pointer to the start of the token (not null-terminated, valid until TKDestroy) on success, null on failure/end of string;
+ */
+char *TKGetNextTokenView(TokenizerT *tk, size_t *length);
+
+/*
+ * Description: returns the next token from the token stream as a view, like TKGetNextTokenView, along with its 64-bit hash (see hash.h)
+ * Parameters: tokenizer from which to extract token, locations in which to store the length and the hash of the token
+ * Modifies: tokenizer->current_position: identifies starting point of next token; *length, *hash: set to the token's length and hash
+ * Returns: pointer to the start of the token (not null-terminated, valid until TKDestroy) on success, null on failure/end of string;
+ */
+char *TKGetNextTokenHashed(TokenizerT *tk, size_t *length, uint64_t *hash);
 #endif